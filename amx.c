@@ -0,0 +1,448 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/amx.c
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "color.h"
+#include "utils.h"
+#include "serve.h"
+#include "amx.h"
+
+/*
+ * Size report for compiled .amx files. The header and the definition
+ * tables are read in place from an mmap of the file - nothing is copied
+ * but the numbers - and compared with the report stored for the same
+ * file by the previous passing build in KOM_AMX_REPORTS. Limits from
+ * [amx] in komodo.toml turn a regression into a failed build:
+ *
+ *   max_file, max_code, max_data, max_memory   bytes
+ *   max_growth                                 percent over the last report
+ */
+
+#define AMX_HEADER_SIZE 56
+#define AMX_LIST_SHOWN  10
+
+enum { AMX_SIZE = 0, AMX_MAGIC = 4, AMX_FILE_VERSION = 6, AMX_FLAGS = 8,
+       AMX_DEFSIZE = 10, AMX_COD = 12, AMX_DAT = 16, AMX_HEA = 20, AMX_STP = 24,
+       AMX_PUBLICS = 32, AMX_NATIVES = 36, AMX_LIBRARIES = 40, AMX_PUBVARS = 44,
+       AMX_TAGS = 48, AMX_NAMETABLE = 52 };
+
+struct amx_names {
+    const char **v;
+    int n;
+};
+
+struct amx_previous {
+    int found;
+    struct kom_amx_report r;
+    char **publics, **natives;
+    int npublics, nnatives;
+};
+
+static uint32_t rd32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t rd16(const unsigned char *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static int name_cmp(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Name of table entry e: inline in old files, in the name table from version 7 */
+static const char *amx_name(const unsigned char *base, size_t len, const unsigned char *e, int defsize) {
+    const unsigned char *name, *end = base + len;
+
+    if (defsize == 8) {
+        uint32_t ofs = rd32(e + 4);
+        if (ofs >= len)
+            return NULL;
+        name = base + ofs;
+    } else {
+        name = e + 4;
+        end = e + defsize < end ? e + defsize : end;
+    }
+    return memchr(name, '\0', (size_t)(end - name)) ? (const char *)name : NULL;
+}
+
+/* Walk the table [from, to) and point names->v into the mapping */
+static int amx_table(const unsigned char *base, size_t len, uint32_t from, uint32_t to,
+                     int defsize, struct amx_names *names)
+{
+    int n = to > from ? (int)((to - from) / (uint32_t)defsize) : 0;
+
+    if (to > len || from > to)
+        return -1;
+    if (names == NULL)
+        return n;
+    names->v = n ? malloc((size_t)n * sizeof(char *)) : NULL;
+    names->n = 0;
+    if (n && names->v == NULL)
+        return -1;
+    for (int i = 0; i < n; i++) {
+        const char *name = amx_name(base, len, base + from + (size_t)i * (size_t)defsize, defsize);
+        if (name)
+            names->v[names->n++] = name;
+    }
+    qsort(names->v, (size_t)names->n, sizeof(char *), name_cmp);
+    return n;
+}
+
+static int amx_parse(const unsigned char *base, size_t len, struct kom_amx_report *r,
+                     struct amx_names *publics, struct amx_names *natives)
+{
+    memset(r, 0, sizeof(*r));
+    if (len < AMX_HEADER_SIZE)
+        return -1;
+
+    uint16_t magic = rd16(base + AMX_MAGIC);
+    r->cell = magic == 0xf1e0 ? 4 : magic == 0xf1e1 ? 8 : magic == 0xf1e2 ? 2 : 0;
+    if (r->cell == 0)
+        return -1;
+    r->file_version = base[AMX_FILE_VERSION];
+    r->flags = rd16(base + AMX_FLAGS);
+
+    int defsize = rd16(base + AMX_DEFSIZE);
+    uint32_t cod = rd32(base + AMX_COD), dat = rd32(base + AMX_DAT);
+    uint32_t hea = rd32(base + AMX_HEA), stp = rd32(base + AMX_STP);
+    uint32_t pub = rd32(base + AMX_PUBLICS), nat = rd32(base + AMX_NATIVES);
+    uint32_t lib = rd32(base + AMX_LIBRARIES), pv = rd32(base + AMX_PUBVARS);
+    uint32_t tags = rd32(base + AMX_TAGS);
+    uint32_t names = r->file_version >= 7 ? rd32(base + AMX_NAMETABLE) : cod;
+
+    if (defsize < 8 || cod > dat || dat > hea || hea > stp || cod > len)
+        return -1;
+
+    /* with AMX_FLAG_COMPACT the code on disk is shorter than dat - cod */
+    r->file = (long)len;
+    r->code = (long)(dat - cod);
+    r->data = (long)(hea - dat);
+    r->heap_stack = (long)(stp - hea);
+    r->memory = (long)stp;
+    r->nametable = r->file_version >= 7 ? (long)(cod - names) : 0;
+
+    r->publics = amx_table(base, len, pub, nat, defsize, publics);
+    r->natives = amx_table(base, len, nat, lib, defsize, natives);
+    r->libraries = amx_table(base, len, lib, pv, defsize, NULL);
+    r->pubvars = amx_table(base, len, pv, tags, defsize, NULL);
+    r->tags = amx_table(base, len, tags, names, defsize, NULL);
+    if (r->publics < 0 || r->natives < 0 || r->libraries < 0 || r->pubvars < 0 || r->tags < 0)
+        return -1;
+    return 0;
+}
+
+/* ---- stored reports ---- */
+
+/* Report file for amx, -1 when the name does not fit */
+static int report_path(char *out, size_t len, const char *amx) {
+    char key[PATH_MAX];
+    const char *p = amx;
+
+    while (p[0] == '.' && p[1] == '/')
+        p += 2;
+    snprintf(key, sizeof(key), "%s", p);
+    for (char *c = key; *c; c++)
+        if (*c == '/') *c = '_';
+    int n = snprintf(out, len, KOM_AMX_REPORTS "/%s.report", key);
+    return n < 0 || (size_t)n >= len ? -1 : 0;
+}
+
+static const struct { const char *key; size_t off; } amx_fields[] = {
+    { "file", offsetof(struct kom_amx_report, file) },
+    { "code", offsetof(struct kom_amx_report, code) },
+    { "data", offsetof(struct kom_amx_report, data) },
+    { "heap_stack", offsetof(struct kom_amx_report, heap_stack) },
+    { "memory", offsetof(struct kom_amx_report, memory) },
+    { "nametable", offsetof(struct kom_amx_report, nametable) },
+};
+
+static const struct { const char *key; size_t off; } amx_counts[] = {
+    { "publics", offsetof(struct kom_amx_report, publics) },
+    { "natives", offsetof(struct kom_amx_report, natives) },
+    { "libraries", offsetof(struct kom_amx_report, libraries) },
+    { "pubvars", offsetof(struct kom_amx_report, pubvars) },
+    { "tags", offsetof(struct kom_amx_report, tags) },
+};
+
+#define AMX_FIELD(r, i) (*(long *)((char *)(r) + amx_fields[i].off))
+#define AMX_COUNT(r, i) (*(int *)((char *)(r) + amx_counts[i].off))
+#define AMX_NFIELDS     (int)(sizeof(amx_fields) / sizeof(amx_fields[0]))
+#define AMX_NCOUNTS     (int)(sizeof(amx_counts) / sizeof(amx_counts[0]))
+
+static void list_add(char ***v, int *n, const char *name) {
+    char **grown = realloc(*v, sizeof(char *) * (size_t)(*n + 1));
+    if (grown == NULL)
+        return;
+    *v = grown;
+    (*v)[(*n)++] = strdup(name);
+}
+
+static void previous_load(struct amx_previous *prev, const char *amx) {
+    char path[PATH_MAX], line[512], key[64];
+    long value;
+    FILE *fp;
+
+    memset(prev, 0, sizeof(*prev));
+    if (report_path(path, sizeof(path), amx) != 0 || (fp = fopen(path, "r")) == NULL)
+        return;
+    prev->found = 1;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strncmp(line, "public ", 7) == 0) {
+            list_add(&prev->publics, &prev->npublics, line + 7);
+            continue;
+        }
+        if (strncmp(line, "native ", 7) == 0) {
+            list_add(&prev->natives, &prev->nnatives, line + 7);
+            continue;
+        }
+        if (sscanf(line, "%63s %ld", key, &value) != 2)
+            continue;
+        for (int i = 0; i < AMX_NFIELDS; i++)
+            if (strcmp(key, amx_fields[i].key) == 0) AMX_FIELD(&prev->r, i) = value;
+        for (int i = 0; i < AMX_NCOUNTS; i++)
+            if (strcmp(key, amx_counts[i].key) == 0) AMX_COUNT(&prev->r, i) = (int)value;
+    }
+    fclose(fp);
+    qsort(prev->publics, (size_t)prev->npublics, sizeof(char *), name_cmp);
+    qsort(prev->natives, (size_t)prev->nnatives, sizeof(char *), name_cmp);
+}
+
+static void previous_free(struct amx_previous *prev) {
+    for (int i = 0; i < prev->npublics; i++)
+        free(prev->publics[i]);
+    for (int i = 0; i < prev->nnatives; i++)
+        free(prev->natives[i]);
+    free(prev->publics);
+    free(prev->natives);
+}
+
+static int report_save(const char *amx, const struct kom_amx_report *r,
+                       const struct amx_names *publics, const struct amx_names *natives)
+{
+    char path[PATH_MAX], tmp[PATH_MAX + 4];
+    FILE *fp;
+
+    kom_mkdir_p(KOM_AMX_REPORTS);
+    if (report_path(path, sizeof(path), amx) != 0)
+        return -1;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ((fp = fopen(tmp, "w")) == NULL)
+        return -1;
+    for (int i = 0; i < AMX_NFIELDS; i++)
+        fprintf(fp, "%s %ld\n", amx_fields[i].key, AMX_FIELD(r, i));
+    for (int i = 0; i < AMX_NCOUNTS; i++)
+        fprintf(fp, "%s %d\n", amx_counts[i].key, AMX_COUNT(r, i));
+    for (int i = 0; i < publics->n; i++)
+        fprintf(fp, "public %s\n", publics->v[i]);
+    for (int i = 0; i < natives->n; i++)
+        fprintf(fp, "native %s\n", natives->v[i]);
+    fclose(fp);
+    return rename(tmp, path);
+}
+
+/* ---- report ---- */
+
+static const char *human(long bytes, char *buf, size_t len) {
+    long a = bytes < 0 ? -bytes : bytes;
+    if (a >= 1048576)
+        snprintf(buf, len, "%.2f MiB", bytes / 1048576.0);
+    else if (a >= 1024)
+        snprintf(buf, len, "%.1f KiB", bytes / 1024.0);
+    else
+        snprintf(buf, len, "%ld B", bytes);
+    return buf;
+}
+
+/* Print the names only in a (prefix '+') or only in b (prefix '-'); both sorted */
+static void names_diff(const char *kind, const char *const *a, int na, char *const *b, int nb) {
+    int i = 0, j = 0, shown = 0, more = 0;
+
+    while (i < na || j < nb) {
+        int c = i == na ? 1 : j == nb ? -1 : strcmp(a[i], b[j]);
+        if (c == 0) {
+            i++;
+            j++;
+            continue;
+        }
+        if (shown++ < AMX_LIST_SHOWN)
+            printf_color(c < 0 ? COL_GREEN : COL_YELLOW, "    %c %s %s", c < 0 ? '+' : '-', kind,
+                         c < 0 ? a[i] : b[j]);
+        else
+            more++;
+        if (c < 0) i++; else j++;
+    }
+    if (more)
+        println("    ... %d more %s changes", more, kind);
+}
+
+static int amx_limits(const char *amx, const struct kom_amx_report *r, const struct amx_previous *prev) {
+    static const char *limit_keys[] = { "max_file", "max_code", "max_data", NULL, "max_memory", NULL };
+    toml_table_t *conf = kom_toml_load();
+    toml_table_t *tab = conf ? toml_table_in(conf, "amx") : NULL;
+    int failed = 0;
+
+    for (int i = 0; tab && i < AMX_NFIELDS; i++) {
+        toml_datum_t v = limit_keys[i] ? toml_int_in(tab, limit_keys[i]) : (toml_datum_t){ 0 };
+        if (v.ok && AMX_FIELD(r, i) > v.u.i) {
+            printf_color(COL_RED, "amx: %s: %s %ld exceeds [amx] %s = %lld", amx,
+                         amx_fields[i].key, AMX_FIELD(r, i), limit_keys[i], (long long)v.u.i);
+            failed = 1;
+        }
+    }
+
+    toml_datum_t growth = tab ? toml_int_in(tab, "max_growth") : (toml_datum_t){ 0 };
+    for (int i = 0; growth.ok && prev->found && i < AMX_NFIELDS; i++) {
+        long before = AMX_FIELD(&prev->r, i), now = AMX_FIELD(r, i);
+        if (limit_keys[i] == NULL || before <= 0)
+            continue;
+        double pct = (now - before) * 100.0 / before;
+        if (pct > (double)growth.u.i) {
+            printf_color(COL_RED, "amx: %s: %s grew %.1f%%, over [amx] max_growth = %lld%%", amx,
+                         amx_fields[i].key, pct, (long long)growth.u.i);
+            failed = 1;
+        }
+    }
+    if (conf)
+        toml_free(conf);
+    return failed;
+}
+
+/*
+ * Report on one .amx, diffed against its last stored report. Returns 0
+ * and stores the new report when within limits, 1 when a limit is
+ * exceeded (the stored report stays at the last good build), -1 when
+ * the file is not a valid AMX. quiet prints a single summary line.
+ */
+int kom_amx_check(const char *path, int quiet) {
+    struct kom_amx_report r;
+    struct amx_names publics = { 0 }, natives = { 0 };
+    struct amx_previous prev;
+    struct stat st;
+    char a[32], b[32], c[32];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < AMX_HEADER_SIZE) {
+        printf_color(COL_RED, "amx: cannot read %s", path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    const unsigned char *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    if (amx_parse(map, (size_t)st.st_size, &r, &publics, &natives) != 0) {
+        printf_color(COL_RED, "amx: %s is not a valid AMX file", path);
+        munmap((void *)map, (size_t)st.st_size);
+        free(publics.v);
+        free(natives.v);
+        return -1;
+    }
+    previous_load(&prev, path);
+
+    if (quiet) {
+        println("amx: %s  code %s (%+ld), data %s (%+ld), memory %s, %d publics, %d natives",
+                path, human(r.code, a, sizeof(a)), prev.found ? r.code - prev.r.code : 0,
+                human(r.data, b, sizeof(b)), prev.found ? r.data - prev.r.data : 0,
+                human(r.memory, c, sizeof(c)), r.publics, r.natives);
+    } else {
+        println("amx: %s  (file version %d, %d-byte cells%s)", path, r.file_version, r.cell,
+                r.flags & 0x04 ? ", compact" : "");
+        for (int i = 0; i < AMX_NFIELDS; i++) {
+            long now = AMX_FIELD(&r, i), before = AMX_FIELD(&prev.r, i);
+            if (prev.found && now != before)
+                println("  %-11s %12s  (%s%s)", amx_fields[i].key, human(now, a, sizeof(a)),
+                        now > before ? "+" : "", human(now - before, b, sizeof(b)));
+            else
+                println("  %-11s %12s", amx_fields[i].key, human(now, a, sizeof(a)));
+        }
+        for (int i = 0; i < AMX_NCOUNTS; i++) {
+            int now = AMX_COUNT(&r, i), before = AMX_COUNT(&prev.r, i);
+            if (prev.found && now != before)
+                println("  %-11s %12d  (%+d)", amx_counts[i].key, now, now - before);
+            else
+                println("  %-11s %12d", amx_counts[i].key, now);
+        }
+        if (prev.found) {
+            names_diff("public", publics.v, publics.n, prev.publics, prev.npublics);
+            names_diff("native", natives.v, natives.n, prev.natives, prev.nnatives);
+        }
+    }
+
+    int failed = amx_limits(path, &r, &prev);
+    if (!failed)
+        report_save(path, &r, &publics, &natives);
+
+    munmap((void *)map, (size_t)st.st_size);
+    free(publics.v);
+    free(natives.v);
+    previous_free(&prev);
+    return failed;
+}
+
+static int amx_dir(const char *dir, int *checked) {
+    char path[PATH_MAX];
+    struct dirent *ent;
+    int failed = 0;
+    DIR *d = opendir(dir);
+
+    if (d == NULL)
+        return 0;
+    while ((ent = readdir(d)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len > 4 && strcmp(ent->d_name + len - 4, ".amx") == 0) {
+            snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+            failed |= kom_amx_check(path, 0) != 0;
+            (*checked)++;
+        }
+    }
+    closedir(d);
+    return failed;
+}
+
+/* amx [file.amx ...]: without files, every .amx under gamemodes/ and filterscripts/ */
+int call_amx(const char *args) {
+    char buf[1024], dir[PATH_MAX];
+    int failed = 0, checked = 0;
+
+    snprintf(buf, sizeof(buf), "%s", args ? args : "");
+    for (char *tok = strtok(buf, " "); tok; tok = strtok(NULL, " ")) {
+        failed |= kom_amx_check(tok, 0) != 0;
+        checked++;
+    }
+    if (checked == 0) {
+        struct kom_server srv;
+        toml_table_t *conf = kom_toml_load();
+        toml_table_t *serve = conf ? toml_table_in(conf, "serve") : NULL;
+        const char *root = kom_server_locate(&srv, serve) == 0 ? srv.dir : ".";
+        snprintf(dir, sizeof(dir), "%s/gamemodes", root);
+        failed |= amx_dir(dir, &checked);
+        snprintf(dir, sizeof(dir), "%s/filterscripts", root);
+        failed |= amx_dir(dir, &checked);
+        if (conf)
+            toml_free(conf);
+    }
+    if (checked == 0)
+        println("amx: no .amx files found");
+    return failed;
+}
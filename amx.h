@@ -0,0 +1,31 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/amx.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef AMX_H
+#define AMX_H
+
+#define KOM_AMX_REPORTS ".komodo/amx"
+
+struct kom_amx_report {
+    int cell;                   /* bytes per cell: 2, 4 or 8 */
+    int file_version;
+    int flags;
+    long file;                  /* size on disk */
+    long code, data;
+    long heap_stack;            /* stp - hea */
+    long memory;                /* stp: whole image once loaded */
+    long nametable;
+    int publics, natives, libraries, pubvars, tags;
+};
+
+int kom_amx_check(const char *path, int quiet);
+int call_amx(const char *args);
+
+#endif
@@ -0,0 +1,994 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/deps.c
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <curl/curl.h>
+
+#include "tomlc99/toml.h"
+
+#include "color.h"
+#include "utils.h"
+#include "package.h"
+#include "progress.h"
+#include "sha256.h"
+#include "deps.h"
+
+/*
+ * Plugin / include dependencies declared in komodo.toml:
+ *
+ *   [dependencies]
+ *   streamer = "samp-incognito/samp-streamer-plugin@^2.9"
+ *   sscanf = { repo = "Y-Less/sscanf", version = "~2.13", asset = "linux" }
+ *
+ * Each package is a GitHub repository. Its tags are listed through the
+ * releases API (falling back to plain tags for include-only repos), and a
+ * komodo.toml at the chosen tag may declare further dependencies. The
+ * graph is resolved in waves, every request of a wave in parallel, and
+ * the result is pinned in komodo.lock with URLs and SHA-256 hashes. While
+ * the lock matches the root dependencies, installs skip resolution and
+ * go straight to the cache or to parallel downloads.
+ */
+
+#define DEPS_MAX          64
+#define DEPS_CONSTRAINTS  8
+#define DEPS_ROUNDS       16
+
+enum {
+    LIST_RELEASES = 0,      /* releases endpoint not fetched yet */
+    LIST_TAGS,              /* no releases, plain tags not fetched yet */
+    LIST_READY,
+    LIST_FAILED
+};
+
+struct dep_constraint {
+    int from;               /* package index that asked for it, -1 = komodo.toml */
+    char spec[64];
+};
+
+struct dep_pkg {
+    char name[64];
+    char repo[128];
+    char asset[64];         /* optional substring an asset name must contain */
+    struct dep_constraint cons[DEPS_CONSTRAINTS];
+    int ncons;
+    int root;
+    int list_state;
+    char *list;             /* raw JSON of the releases or tags endpoint */
+    char version[64];       /* picked tag */
+    char manifest_tag[64];  /* tag whose komodo.toml has been read */
+    char url[KOM_URL_MAX];
+    char file[128];
+    char sha256[KOM_SHA256_HEX];
+};
+
+static struct dep_pkg __deps[DEPS_MAX];
+static int __ndeps;
+
+struct dep_fetch {
+    const char *url;
+    char *body;
+    size_t len;
+    long code;
+};
+
+/* ---- small JSON scanner: only string values of known keys are needed ---- */
+
+static const char *json_next_string(const char *p, const char *key,
+                                    char *out, size_t len)
+{
+    char pat[64];
+    snprintf(pat, sizeof(pat), "\"%s\"", key);
+
+    while ((p = strstr(p, pat)) != NULL) {
+        p += strlen(pat);
+        while (isspace((unsigned char)*p)) p++;
+        if (*p != ':')
+            continue;
+        p++;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p != '"')
+            continue;
+        p++;
+
+        size_t n = 0;
+        while (*p && *p != '"') {
+            char c = *p++;
+            if (c == '\\' && *p)
+                c = *p++;
+            if (n + 1 < len)
+                out[n++] = c;
+        }
+        out[n] = '\0';
+        return *p ? p + 1 : p;
+    }
+    return NULL;
+}
+
+/* ---- versions and constraints ---- */
+
+struct dep_version {
+    long part[4];
+    int nparts;
+    int pre;                /* -rc1, -beta, ... */
+};
+
+static int version_parse(const char *tag, struct dep_version *v) {
+    memset(v, 0, sizeof(*v));
+    while (*tag && !isdigit((unsigned char)*tag))
+        tag++;
+    if (!*tag)
+        return -1;
+
+    while (v->nparts < 4 && isdigit((unsigned char)*tag)) {
+        v->part[v->nparts++] = strtol(tag, (char **)&tag, 10);
+        if (*tag != '.')
+            break;
+        tag++;
+    }
+    v->pre = *tag == '-' || isalpha((unsigned char)*tag);
+    return 0;
+}
+
+/* Compare only the components b spells out, so "2.9" covers 2.9.x */
+static int version_cmp(const struct dep_version *a, const struct dep_version *b, int nparts) {
+    for (int i = 0; i < nparts; i++) {
+        if (a->part[i] != b->part[i])
+            return a->part[i] < b->part[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static int spec_match_one(const char *spec, const char *tag, const struct dep_version *v) {
+    struct dep_version want;
+    const char *op = spec;
+
+    while (isspace((unsigned char)*op)) op++;
+    if (*op == '\0' || strcmp(op, "*") == 0)
+        return !v->pre;
+    if (strcmp(op, tag) == 0)
+        return 1;   /* exact tag, also allows pre-releases */
+
+    char kind[3] = { 0 };
+    if (op[0] == '>' || op[0] == '<') {
+        kind[0] = op[0];
+        if (op[1] == '=')
+            kind[1] = '=';
+    } else if (op[0] == '^' || op[0] == '~' || op[0] == '=') {
+        kind[0] = op[0];
+    }
+    if (version_parse(op + strlen(kind), &want) != 0)
+        return 0;
+    if (v->pre && !want.pre)
+        return 0;
+
+    int full = version_cmp(v, &want, 4);
+    switch (kind[0]) {
+    case '>':
+        return kind[1] ? full >= 0 : full > 0;
+    case '<':
+        return kind[1] ? full <= 0 : full < 0;
+    case '^':
+        /* same leading non-zero component */
+        if (full < 0)
+            return 0;
+        return want.part[0] ? v->part[0] == want.part[0]
+                            : version_cmp(v, &want, 2) == 0;
+    case '~':
+        if (full < 0)
+            return 0;
+        return version_cmp(v, &want, want.nparts > 1 ? 2 : 1) == 0;
+    default:
+        return version_cmp(v, &want, want.nparts) == 0;
+    }
+}
+
+/* A spec may hold several comma-separated clauses: ">=1.0, <2.0" */
+static int spec_match(const char *spec, const char *tag) {
+    struct dep_version v;
+    char buf[64];
+
+    if (version_parse(tag, &v) != 0)
+        return strcmp(spec, tag) == 0;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *save = NULL, *clause = strtok_r(buf, ",", &save);
+         clause; clause = strtok_r(NULL, ",", &save)) {
+        if (!spec_match_one(clause, tag, &v))
+            return 0;
+    }
+    return 1;
+}
+
+/* ---- graph bookkeeping ---- */
+
+static int deps_find(const char *name) {
+    for (int i = 0; i < __ndeps; i++) {
+        if (strcmp(__deps[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Package names and cache file names end up in paths under KOM_CACHE_DIR
+ * and KOM_DEPS_DIR, so they are limited to [A-Za-z0-9._-] and may not be
+ * "." or "..".
+ */
+static int deps_name_char(int c) {
+    return isalnum(c) || c == '.' || c == '_' || c == '-';
+}
+
+static int deps_name_ok(const char *name) {
+    if (!name[0] || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        return 0;
+    for (const char *p = name; *p; p++) {
+        if (!deps_name_char((unsigned char)*p))
+            return 0;
+    }
+    return 1;
+}
+
+static int deps_add(const char *name, const char *repo, const char *spec,
+                    const char *asset, int from)
+{
+    int i = deps_find(name);
+
+    if (!deps_name_ok(name)) {
+        printf_color(COL_RED, "dependencies: '%s' is not a valid package name", name);
+        return -1;
+    }
+    if (i < 0) {
+        if (__ndeps >= DEPS_MAX) {
+            printf_color(COL_RED, "dependencies: more than %d packages", DEPS_MAX);
+            return -1;
+        }
+        i = __ndeps++;
+        memset(&__deps[i], 0, sizeof(__deps[i]));
+        snprintf(__deps[i].name, sizeof(__deps[i].name), "%s", name);
+        snprintf(__deps[i].repo, sizeof(__deps[i].repo), "%s", repo);
+        snprintf(__deps[i].asset, sizeof(__deps[i].asset), "%s", asset);
+    } else if (strcasecmp(__deps[i].repo, repo) != 0) {
+        printf_color(COL_YELLOW, "dependencies: '%s' is %s, ignoring %s",
+                     name, __deps[i].repo, repo);
+    }
+
+    struct dep_pkg *d = &__deps[i];
+    if (from < 0)
+        d->root = 1;
+    if (d->ncons < DEPS_CONSTRAINTS) {
+        d->cons[d->ncons].from = from;
+        snprintf(d->cons[d->ncons].spec, sizeof(d->cons[0].spec), "%s", spec);
+        d->ncons++;
+    }
+    return i;
+}
+
+static void deps_drop_from(int from) {
+    for (int i = 0; i < __ndeps; i++) {
+        struct dep_pkg *d = &__deps[i];
+        int n = 0;
+        for (int c = 0; c < d->ncons; c++) {
+            if (d->cons[c].from != from)
+                d->cons[n++] = d->cons[c];
+        }
+        d->ncons = n;
+    }
+}
+
+/*
+ * Forget what orphaned packages asked for, until no drop orphans another.
+ * Returns the number of packages dropped.
+ */
+static int deps_drop_orphans(void) {
+    int dropped = 0, again = 1;
+
+    while (again) {
+        again = 0;
+        for (int i = 0; i < __ndeps; i++) {
+            struct dep_pkg *d = &__deps[i];
+            if (d->ncons > 0 || d->manifest_tag[0] == '\0')
+                continue;
+            deps_drop_from(i);
+            d->manifest_tag[0] = '\0';
+            d->version[0] = '\0';
+            dropped++;
+            again = 1;
+        }
+    }
+    return dropped;
+}
+
+/*
+ * Read a [dependencies] table. Values are either "owner/repo@spec" or an
+ * inline table with repo, version and asset keys.
+ */
+static int deps_read_table(toml_table_t *tab, int from) {
+    const char *key;
+
+    for (int k = 0; (key = toml_key_in(tab, k)) != NULL; k++) {
+        char repo[128] = "", spec[64] = "*", asset[64] = "";
+        toml_datum_t str = toml_string_in(tab, key);
+
+        if (str.ok) {
+            char *at = strchr(str.u.s, '@');
+            if (at) {
+                *at = '\0';
+                snprintf(spec, sizeof(spec), "%s", at + 1);
+            }
+            snprintf(repo, sizeof(repo), "%s", str.u.s);
+            free(str.u.s);
+        } else {
+            toml_table_t *t = toml_table_in(tab, key);
+            if (t == NULL)
+                continue;
+            toml_datum_t r = toml_string_in(t, "repo");
+            toml_datum_t v = toml_string_in(t, "version");
+            toml_datum_t a = toml_string_in(t, "asset");
+            if (r.ok) { snprintf(repo, sizeof(repo), "%s", r.u.s); free(r.u.s); }
+            if (v.ok) { snprintf(spec, sizeof(spec), "%s", v.u.s); free(v.u.s); }
+            if (a.ok) { snprintf(asset, sizeof(asset), "%s", a.u.s); free(a.u.s); }
+        }
+
+        if (strchr(repo, '/') == NULL) {
+            printf_color(COL_RED, "dependencies: '%s' needs repo = \"owner/name\"", key);
+            return -1;
+        }
+        if (deps_add(key, repo, spec, asset, from) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* ---- parallel HTTP ---- */
+
+static size_t fetch_write(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    struct dep_fetch *f = userdata;
+    size_t n = size * nmemb;
+    char *body = realloc(f->body, f->len + n + 1);
+
+    if (body == NULL)
+        return 0;
+    memcpy(body + f->len, ptr, n);
+    f->len += n;
+    body[f->len] = '\0';
+    f->body = body;
+    return n;
+}
+
+static struct curl_slist *github_headers(void) {
+    struct curl_slist *h = NULL;
+    const char *token = getenv("GITHUB_TOKEN");
+
+    h = curl_slist_append(h, "Accept: application/vnd.github+json");
+    if (token && *token) {
+        char auth[512];
+        snprintf(auth, sizeof(auth), "Authorization: Bearer %s", token);
+        h = curl_slist_append(h, auth);
+    }
+    return h;
+}
+
+/* Fetch every request into memory at once over the shared connection pool */
+static void fetch_many(struct dep_fetch *req, int count) {
+    CURLM *multi = curl_multi_init();
+    CURL *easy[DEPS_MAX];
+    struct curl_slist *headers = github_headers();
+    int running = 0;
+
+    for (int i = 0; i < count; i++) {
+        req[i].body = NULL;
+        req[i].len = 0;
+        req[i].code = 0;
+        easy[i] = curl_easy_init();
+        curl_easy_setopt(easy[i], CURLOPT_URL, req[i].url);
+        curl_easy_setopt(easy[i], CURLOPT_SHARE, kom_curl_share());
+        curl_easy_setopt(easy[i], CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(easy[i], CURLOPT_USERAGENT, "komodo");
+        curl_easy_setopt(easy[i], CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy[i], CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(easy[i], CURLOPT_WRITEFUNCTION, fetch_write);
+        curl_easy_setopt(easy[i], CURLOPT_WRITEDATA, &req[i]);
+        curl_multi_add_handle(multi, easy[i]);
+    }
+
+    do {
+        curl_multi_perform(multi, &running);
+        if (running)
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+    } while (running);
+
+    for (int i = 0; i < count; i++) {
+        curl_easy_getinfo(easy[i], CURLINFO_RESPONSE_CODE, &req[i].code);
+        curl_multi_remove_handle(multi, easy[i]);
+        curl_easy_cleanup(easy[i]);
+    }
+    curl_multi_cleanup(multi);
+    curl_slist_free_all(headers);
+}
+
+/* ---- resolution ---- */
+
+static int asset_score(const char *url, const char *platform, const char *filter) {
+    char name[KOM_URL_MAX];
+    const char *base = strrchr(url, '/');
+
+    snprintf(name, sizeof(name), "%s", base ? base + 1 : url);
+    if (filter[0] && strstr(name, filter) == NULL)
+        return -1;
+    for (char *p = name; *p; p++)
+        *p = (char)tolower((unsigned char)*p);
+
+    size_t len = strlen(name);
+    int ok = 0;
+    const char *exts[] = { ".zip", ".tar.gz", ".tgz", ".so", ".dll", ".inc" };
+    for (int i = 0; i < 6; i++) {
+        size_t el = strlen(exts[i]);
+        if (len > el && strcmp(name + len - el, exts[i]) == 0)
+            ok = 1;
+    }
+    if (!ok)
+        return -1;
+
+    int is_linux = strstr(name, "linux") || strstr(name, ".so") ||
+                   strstr(name, "ubuntu") || strstr(name, "debian");
+    int is_win = strstr(name, "win") || strstr(name, ".dll");
+    int want_linux = strcmp(platform, "windows") != 0;
+
+    if (is_linux && is_win)
+        return 1;
+    if (want_linux ? is_win : is_linux)
+        return -1;
+    return (want_linux ? is_linux : is_win) ? 10 : 1;
+}
+
+/* Pick the archive for d->version: best release asset, else the source tarball */
+static void deps_pick_asset(struct dep_pkg *d, const char *platform) {
+    char needle[192], url[KOM_URL_MAX];
+    int best = -1;
+
+    d->url[0] = '\0';
+    snprintf(needle, sizeof(needle), "/releases/download/%s/", d->version);
+
+    if (d->list_state == LIST_READY && d->list) {
+        const char *p = d->list;
+        while ((p = json_next_string(p, "browser_download_url", url, sizeof(url))) != NULL) {
+            if (strstr(url, needle) == NULL)
+                continue;
+            int score = asset_score(url, platform, d->asset);
+            if (score > best) {
+                best = score;
+                snprintf(d->url, sizeof(d->url), "%s", url);
+            }
+        }
+    }
+
+    if (best < 0) {
+        snprintf(d->url, sizeof(d->url), "https://github.com/%s/archive/refs/tags/%s.tar.gz",
+                 d->repo, d->version);
+        snprintf(d->file, sizeof(d->file), "%s-%s.tar.gz", d->name, d->version);
+    } else {
+        snprintf(d->file, sizeof(d->file), "%s", strrchr(d->url, '/') + 1);
+    }
+
+    /* tags like release/1.0 must not turn into directories in the cache */
+    for (char *p = d->file; *p; p++) {
+        if (!deps_name_char((unsigned char)*p))
+            *p = '_';
+    }
+    if (!deps_name_ok(d->file))
+        snprintf(d->file, sizeof(d->file), "%s.tar.gz", d->name);
+}
+
+/* Highest tag in the listing that satisfies every constraint on d */
+static int deps_pick_version(struct dep_pkg *d) {
+    const char *key = strstr(d->list, "\"tag_name\"") ? "tag_name" : "name";
+    const char *p = d->list;
+    char tag[64], best[64] = "";
+    struct dep_version bv = { 0 }, tv;
+
+    while ((p = json_next_string(p, key, tag, sizeof(tag))) != NULL) {
+        int ok = 1;
+        for (int c = 0; c < d->ncons && ok; c++)
+            ok = spec_match(d->cons[c].spec, tag);
+        if (!ok)
+            continue;
+        version_parse(tag, &tv);
+        if (!best[0] || version_cmp(&tv, &bv, 4) > 0 || (tv.pre < bv.pre && version_cmp(&tv, &bv, 4) == 0)) {
+            snprintf(best, sizeof(best), "%s", tag);
+            bv = tv;
+        }
+    }
+
+    if (!best[0])
+        return -1;
+    snprintf(d->version, sizeof(d->version), "%s", best);
+    return 0;
+}
+
+static int deps_resolve(const char *platform) {
+    struct dep_fetch req[DEPS_MAX];
+    int owner[DEPS_MAX];
+    char urls[DEPS_MAX][KOM_URL_MAX];
+
+    for (int round = 0; round < DEPS_ROUNDS; round++) {
+        int n = 0, progressed = 0;
+
+        /* 1. tag listings for every package that has none yet */
+        for (int i = 0; i < __ndeps; i++) {
+            struct dep_pkg *d = &__deps[i];
+            if (d->ncons == 0 || d->list_state >= LIST_READY)
+                continue;
+            snprintf(urls[n], KOM_URL_MAX, "https://api.github.com/repos/%s/%s?per_page=100",
+                     d->repo, d->list_state == LIST_TAGS ? "tags" : "releases");
+            req[n].url = urls[n];
+            owner[n++] = i;
+        }
+        if (n) {
+            fetch_many(req, n);
+            progressed = 1;
+        }
+        for (int r = 0; r < n; r++) {
+            struct dep_pkg *d = &__deps[owner[r]];
+            if (req[r].code != 200 || req[r].body == NULL) {
+                printf_color(COL_RED, "dependencies: %s: listing failed (HTTP %ld)", d->repo, req[r].code);
+                free(req[r].body);
+                d->list_state = LIST_FAILED;
+                return -1;
+            }
+            if (d->list_state == LIST_RELEASES && strstr(req[r].body, "\"tag_name\"") == NULL) {
+                free(req[r].body);
+                d->list_state = LIST_TAGS;  /* include-only repo, try plain tags */
+                continue;
+            }
+            d->list = req[r].body;
+            d->list_state = LIST_READY;
+        }
+
+        /* 2. pick versions; a new pick needs its manifest (re-)read */
+        n = 0;
+        for (int i = 0; i < __ndeps; i++) {
+            struct dep_pkg *d = &__deps[i];
+            if (d->ncons == 0 || d->list_state != LIST_READY)
+                continue;
+            if (deps_pick_version(d) != 0) {
+                printf_color(COL_RED, "dependencies: no version of %s satisfies:", d->name);
+                for (int c = 0; c < d->ncons; c++) {
+                    printf("  %s (from %s)\n", d->cons[c].spec,
+                           d->cons[c].from < 0 ? "komodo.toml" : __deps[d->cons[c].from].name);
+                }
+                return -1;
+            }
+            if (strcmp(d->manifest_tag, d->version) == 0)
+                continue;
+            snprintf(urls[n], KOM_URL_MAX, "https://raw.githubusercontent.com/%s/%s/komodo.toml",
+                     d->repo, d->version);
+            req[n].url = urls[n];
+            owner[n++] = i;
+        }
+
+        /* 3. transitive dependencies from the packages' own komodo.toml */
+        if (n) {
+            fetch_many(req, n);
+            progressed = 1;
+        }
+        for (int r = 0; r < n; r++) {
+            int i = owner[r];
+            deps_drop_from(i);
+            memcpy(__deps[i].manifest_tag, __deps[i].version, sizeof(__deps[i].manifest_tag));
+
+            if (req[r].code == 200 && req[r].body) {
+                char errbuf[256];
+                toml_table_t *conf = toml_parse(req[r].body, errbuf, sizeof(errbuf));
+                toml_table_t *tab = conf ? toml_table_in(conf, "dependencies") : NULL;
+                if (tab && deps_read_table(tab, i) != 0) {
+                    toml_free(conf);
+                    free(req[r].body);
+                    return -1;
+                }
+                if (conf)
+                    toml_free(conf);
+            }
+            free(req[r].body);
+        }
+
+        /* 4. a package nobody asks for any more takes its own requests with it */
+        if (deps_drop_orphans())
+            progressed = 1;
+
+        if (!progressed) {
+            for (int i = 0; i < __ndeps; i++) {
+                if (__deps[i].ncons > 0)
+                    deps_pick_asset(&__deps[i], platform);
+            }
+            return 0;
+        }
+    }
+
+    printf_color(COL_RED, "dependencies: graph did not settle after %d rounds", DEPS_ROUNDS);
+    return -1;
+}
+
+/* ---- lockfile ---- */
+
+static int lock_write(void) {
+    FILE *fp = fopen(KOM_LOCK_FILE ".tmp", "w");
+    if (fp == NULL)
+        return -1;
+
+    fprintf(fp, "# komodo.lock: generated by komodo install, do not edit.\n");
+    for (int i = 0; i < __ndeps; i++) {
+        struct dep_pkg *d = &__deps[i];
+        if (d->ncons == 0)
+            continue;
+        fprintf(fp, "\n[[package]]\n");
+        fprintf(fp, "name = \"%s\"\n", d->name);
+        fprintf(fp, "repo = \"%s\"\n", d->repo);
+        if (d->root) {
+            /* the root spec is what invalidates the lock when komodo.toml changes */
+            for (int c = 0; c < d->ncons; c++) {
+                if (d->cons[c].from < 0)
+                    fprintf(fp, "constraint = \"%s\"\n", d->cons[c].spec);
+            }
+            fprintf(fp, "asset_filter = \"%s\"\n", d->asset);
+        }
+        fprintf(fp, "root = %s\n", d->root ? "true" : "false");
+        fprintf(fp, "version = \"%s\"\n", d->version);
+        fprintf(fp, "url = \"%s\"\n", d->url);
+        fprintf(fp, "file = \"%s\"\n", d->file);
+        fprintf(fp, "sha256 = \"%s\"\n", d->sha256);
+    }
+
+    if (fclose(fp) != 0)
+        return -1;
+    return rename(KOM_LOCK_FILE ".tmp", KOM_LOCK_FILE);
+}
+
+static void lock_str(toml_table_t *t, const char *key, char *out, size_t len) {
+    out[0] = '\0';
+    kom_toml_string(t, key, out, len);
+}
+
+/*
+ * Replace the root set with the locked graph when the lock was produced
+ * from the same root dependencies; 1 if the lock was taken.
+ */
+static int lock_load(void) {
+    FILE *fp = fopen(KOM_LOCK_FILE, "r");
+    char errbuf[256];
+
+    if (fp == NULL)
+        return 0;
+    toml_table_t *conf = toml_parse_file(fp, errbuf, sizeof(errbuf));
+    fclose(fp);
+    if (conf == NULL) {
+        printf_color(COL_YELLOW, "%s: %s, resolving again", KOM_LOCK_FILE, errbuf);
+        return 0;
+    }
+
+    toml_array_t *pkgs = toml_array_in(conf, "package");
+    int n = pkgs ? toml_array_nelem(pkgs) : 0;
+    int roots = 0, valid = n > 0 && n <= DEPS_MAX;
+    static struct dep_pkg locked[DEPS_MAX];
+
+    for (int i = 0; i < n && valid; i++) {
+        toml_table_t *t = toml_table_at(pkgs, i);
+        struct dep_pkg *d = &locked[i];
+        char spec[64];
+
+        memset(d, 0, sizeof(*d));
+        lock_str(t, "name", d->name, sizeof(d->name));
+        lock_str(t, "repo", d->repo, sizeof(d->repo));
+        lock_str(t, "asset_filter", d->asset, sizeof(d->asset));
+        lock_str(t, "version", d->version, sizeof(d->version));
+        lock_str(t, "url", d->url, sizeof(d->url));
+        lock_str(t, "file", d->file, sizeof(d->file));
+        lock_str(t, "sha256", d->sha256, sizeof(d->sha256));
+        lock_str(t, "constraint", spec, sizeof(spec));
+        toml_datum_t root = toml_bool_in(t, "root");
+        d->root = root.ok && root.u.b;
+        d->ncons = 1;
+        d->cons[0].from = -1;
+        snprintf(d->cons[0].spec, sizeof(d->cons[0].spec), "%s", d->version);
+
+        if (!deps_name_ok(d->name) || !d->url[0] || !deps_name_ok(d->file)) {
+            valid = 0;
+            break;
+        }
+        if (!d->root)
+            continue;
+
+        /* every locked root must match komodo.toml exactly */
+        roots++;
+        int k = deps_find(d->name);
+        if (k < 0 || !__deps[k].root || strcasecmp(__deps[k].repo, d->repo) != 0 ||
+            strcmp(__deps[k].cons[0].spec, spec) != 0 || strcmp(__deps[k].asset, d->asset) != 0)
+            valid = 0;
+    }
+    toml_free(conf);
+
+    int want = 0;
+    for (int i = 0; i < __ndeps; i++)
+        want += __deps[i].root;
+    if (!valid || roots != want)
+        return 0;
+
+    memcpy(__deps, locked, sizeof(locked[0]) * n);
+    __ndeps = n;
+    return 1;
+}
+
+/* ---- download, cache, extract ---- */
+
+struct dep_download {
+    struct dep_pkg *pkg;
+    FILE *fp;
+    struct kom_sha256 sha;
+    int prog;
+    int failed;
+    char part[512];
+};
+
+static size_t download_write(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    struct dep_download *dl = userdata;
+    size_t n = fwrite(ptr, size, nmemb, dl->fp);
+    kom_sha256_update(&dl->sha, ptr, n * size);
+    return n;
+}
+
+static int cache_path(const struct dep_pkg *d, char *out, size_t len) {
+    int n = snprintf(out, len, KOM_CACHE_DIR "/%s-%s", d->sha256, d->file);
+    return n < 0 || (size_t)n >= len ? -1 : 0;
+}
+
+/* Download every package not already in the cache, all in parallel */
+static int deps_download(void) {
+    static struct dep_download dl[DEPS_MAX];
+    CURL *easy[DEPS_MAX];
+    CURLM *multi = curl_multi_init();
+    struct curl_slist *headers = github_headers();
+    int count = 0, running = 0, failed = 0;
+
+    for (int i = 0; i < __ndeps; i++) {
+        struct dep_pkg *d = &__deps[i];
+        char cached[512], hex[KOM_SHA256_HEX];
+
+        if (d->ncons == 0)
+            continue;
+        if (d->sha256[0] && cache_path(d, cached, sizeof(cached)) == 0) {
+            if (kom_sha256_file(cached, hex) == 0 && strcmp(hex, d->sha256) == 0)
+                continue;   /* cache hit */
+        }
+
+        struct dep_download *x = &dl[count];
+        memset(x, 0, sizeof(*x));
+        x->pkg = d;
+        snprintf(x->part, sizeof(x->part), KOM_CACHE_DIR "/%s.part", d->name);
+        x->fp = fopen(x->part, "wb");
+        if (x->fp == NULL) {
+            perror("[err]: failed to open file for writing");
+            failed++;
+            continue;
+        }
+        kom_sha256_init(&x->sha);
+        x->prog = kom_progress_add(d->file, 0);
+
+        easy[count] = curl_easy_init();
+        curl_easy_setopt(easy[count], CURLOPT_URL, d->url);
+        curl_easy_setopt(easy[count], CURLOPT_SHARE, kom_curl_share());
+        curl_easy_setopt(easy[count], CURLOPT_USERAGENT, "komodo");
+        curl_easy_setopt(easy[count], CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy[count], CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(easy[count], CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(easy[count], CURLOPT_WRITEFUNCTION, download_write);
+        curl_easy_setopt(easy[count], CURLOPT_WRITEDATA, x);
+        curl_easy_setopt(easy[count], CURLOPT_XFERINFOFUNCTION, progress_callback);
+        curl_easy_setopt(easy[count], CURLOPT_XFERINFODATA, (void *)(intptr_t)x->prog);
+        curl_easy_setopt(easy[count], CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(easy[count], CURLOPT_PRIVATE, (void *)x);
+        curl_multi_add_handle(multi, easy[count]);
+        count++;
+    }
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, 8L);
+
+    do {
+        curl_multi_perform(multi, &running);
+        if (running)
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+    } while (running);
+
+    CURLMsg *msg;
+    int left;
+    while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+        struct dep_download *x = NULL;
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&x);
+        if (msg->data.result != CURLE_OK) {
+            fprintf(stderr, "[err]: %s: %s\n", x->pkg->name, curl_easy_strerror(msg->data.result));
+            x->failed = 1;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct dep_download *x = &dl[i];
+        struct dep_pkg *d = x->pkg;
+        char hex[KOM_SHA256_HEX], cached[512];
+
+        kom_progress_done(x->prog);
+        fclose(x->fp);
+        curl_multi_remove_handle(multi, easy[i]);
+        curl_easy_cleanup(easy[i]);
+
+        if (x->failed) {
+            unlink(x->part);
+            failed++;
+            continue;
+        }
+
+        kom_sha256_final(&x->sha, hex);
+        if (d->sha256[0] && strcmp(d->sha256, hex) != 0) {
+            printf_color(COL_RED, "dependencies: %s: hash mismatch, expected %s got %s",
+                         d->name, d->sha256, hex);
+            unlink(x->part);
+            failed++;
+            continue;
+        }
+        snprintf(d->sha256, sizeof(d->sha256), "%s", hex);
+        if (cache_path(d, cached, sizeof(cached)) != 0 || rename(x->part, cached) != 0) {
+            perror("[err]: cache");
+            failed++;
+        }
+    }
+
+    curl_multi_cleanup(multi);
+    curl_slist_free_all(headers);
+    kom_progress_wait();
+    return failed;
+}
+
+/* Plain plugin/include files are copied as-is next to extracted archives */
+static int install_single_file(const char *path, const char *dest, void *ctx) {
+    const struct dep_pkg *d = ctx;
+    char target[1024], buf[65536];
+    size_t n;
+    int err = 0;
+
+    snprintf(target, sizeof(target), "%s/%s", dest, d->file);
+    FILE *in = fopen(path, "rb");
+    FILE *out = in ? fopen(target, "wb") : NULL;
+    if (out == NULL) {
+        if (in) fclose(in);
+        return 1;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) {
+            err = 1;
+            break;
+        }
+    }
+    fclose(in);
+    return fclose(out) != 0 || err;
+}
+
+static int deps_extract(void) {
+    static struct kom_extract_job jobs[DEPS_MAX];
+    static char paths[DEPS_MAX][512], dests[DEPS_MAX][256];
+    int count = 0;
+
+    for (int i = 0; i < __ndeps; i++) {
+        struct dep_pkg *d = &__deps[i];
+        if (d->ncons == 0)
+            continue;
+
+        int n = snprintf(dests[count], sizeof(dests[count]), KOM_DEPS_DIR "/%s", d->name);
+        if (cache_path(d, paths[count], sizeof(paths[count])) != 0 ||
+            n < 0 || (size_t)n >= sizeof(dests[count])) {
+            printf_color(COL_RED, "dependencies: %s: path too long", d->name);
+            return 1;
+        }
+        if (kom_mkdir_p(dests[count]) != 0) {
+            perror("[err]: " KOM_DEPS_DIR);
+            return 1;
+        }
+
+        size_t len = strlen(d->file);
+        int single = (len > 3 && strcmp(d->file + len - 3, ".so") == 0) ||
+                     (len > 4 && (strcmp(d->file + len - 4, ".dll") == 0 ||
+                                  strcmp(d->file + len - 4, ".inc") == 0));
+        jobs[count].path = paths[count];
+        jobs[count].dest = dests[count];
+        jobs[count].extract = single ? install_single_file : NULL;
+        jobs[count].ctx = d;
+        jobs[count].result = 0;
+        count++;
+    }
+
+    int failed = kom_extract_parallel(jobs, count);
+    kom_progress_wait();
+    return failed;
+}
+
+static void deps_reset(void) {
+    for (int i = 0; i < __ndeps; i++)
+        free(__deps[i].list);
+    memset(__deps, 0, sizeof(__deps));
+    __ndeps = 0;
+}
+
+/*
+ * `install`: resolve (or reuse komodo.lock), fetch and unpack every
+ * dependency. With update set the lock is ignored and rewritten.
+ */
+int call_deps_install(int update) {
+    int ret = 1;
+    toml_table_t *conf = kom_toml_load();
+
+    if (conf == NULL) {
+        printf_color(COL_RED, "install: komodo.toml not found or invalid");
+        return 1;
+    }
+
+    deps_reset();
+    toml_table_t *tab = toml_table_in(conf, "dependencies");
+    if (tab == NULL || deps_read_table(tab, -1) != 0 || __ndeps == 0) {
+        if (tab == NULL || __ndeps == 0)
+            println("install: no [dependencies] in komodo.toml");
+        toml_free(conf);
+        return tab == NULL ? 0 : 1;
+    }
+    toml_free(conf);
+
+    if (kom_mkdir_p(KOM_CACHE_DIR) != 0) {
+        perror("[err]: " KOM_CACHE_DIR);
+        return 1;
+    }
+
+    const char *platform = komodo_os && strcmp(komodo_os, "windows") == 0 ? "windows" : "linux";
+    int locked = !update && lock_load();
+
+    if (locked) {
+        println(":: %s is up to date, %d packages", KOM_LOCK_FILE, __ndeps);
+    } else {
+        println(":: Resolving %d dependencies for %s...", __ndeps, platform);
+        if (deps_resolve(platform) != 0)
+            goto out;
+    }
+
+    if (deps_download() != 0) {
+        printf_color(COL_RED, "install: some downloads failed");
+        goto out;
+    }
+    if (!locked && lock_write() != 0) {
+        perror("[err]: " KOM_LOCK_FILE);
+        goto out;
+    }
+    if (deps_extract() != 0) {
+        printf_color(COL_RED, "install: some packages failed to extract");
+        goto out;
+    }
+
+    for (int i = 0; i < __ndeps; i++) {
+        if (__deps[i].ncons > 0)
+            println("  %-20s %-12s %s", __deps[i].name, __deps[i].version, __deps[i].file);
+    }
+    printf_color(COL_GREEN, "install: done");
+    ret = 0;
+
+out:
+    deps_reset();
+    return ret;
+}
@@ -0,0 +1,20 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/deps.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef DEPS_H
+#define DEPS_H
+
+#define KOM_LOCK_FILE   "komodo.lock"
+#define KOM_CACHE_DIR   ".komodo/cache"
+#define KOM_DEPS_DIR    "dependencies"
+
+int call_deps_install(int update);
+
+#endif
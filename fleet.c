@@ -0,0 +1,832 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/fleet.c
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+
+#include "color.h"
+#include "utils.h"
+#include "serve.h"
+#include "fleet.h"
+
+/*
+ * `fleet`: many server instances from one installed package.
+ *
+ *   [fleet]
+ *   instances = 4
+ *   base_port = 7777
+ *   port_step = 1
+ *   pin = "core"              # "core", "numa" or "none"
+ *   cpu_max = "50000 100000"  # cgroup v2 cpu.max, optional
+ *   memory_max = "512M"       # cgroup v2 memory.max, optional
+ *
+ * `fleet create` materialises fleet/instance-N: everything in the server
+ * directory is symlinked, server.cfg / config.json are copied with the
+ * instance port, and scriptfiles is copied so databases stay per-instance.
+ * Instances run detached with their pid in komodo.pid, each pinned with
+ * sched_setaffinity to its own core (or NUMA node, with memory preferred
+ * from that node) and optionally placed in its own cgroup. With more
+ * instances than cores, pin = "core" wraps around: start and status warn
+ * and status marks shared cores as "cpu N xK".
+ */
+
+#define FLEET_STOP_GRACE_MS   5000
+#define FLEET_READY_MS        30000
+#define FLEET_CGROUP_ROOT     "/sys/fs/cgroup/komodo"
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+struct fleet_conf {
+    int instances;
+    int base_port;
+    int port_step;
+    char pin[16];
+    char cpu_max[64];
+    char memory_max[32];
+    char cgroup_root[256];
+    struct kom_server srv;
+};
+
+/* not symlinked into instances: per-instance configs, state and logs */
+static const char *__fleet_private[] = {
+    "server.cfg", "config.json", "scriptfiles", "server_log.txt", "log.txt",
+    "logs", "crashinfo.txt", "console.log", "komodo.pid", "komodo.port", NULL
+};
+
+static int fleet_load_conf(struct fleet_conf *fc) {
+    toml_table_t *conf = kom_toml_load();
+    toml_table_t *fleet = conf ? toml_table_in(conf, "fleet") : NULL;
+    toml_table_t *serve = conf ? toml_table_in(conf, "serve") : NULL;
+    toml_datum_t v;
+
+    memset(fc, 0, sizeof(*fc));
+    fc->instances = 2;
+    fc->base_port = 7777;
+    fc->port_step = 1;
+    snprintf(fc->pin, sizeof(fc->pin), "core");
+    snprintf(fc->cgroup_root, sizeof(fc->cgroup_root), FLEET_CGROUP_ROOT);
+
+    if (fleet) {
+        if ((v = toml_int_in(fleet, "instances")).ok) fc->instances = (int)v.u.i;
+        if ((v = toml_int_in(fleet, "base_port")).ok) fc->base_port = (int)v.u.i;
+        if ((v = toml_int_in(fleet, "port_step")).ok) fc->port_step = (int)v.u.i;
+        kom_toml_string(fleet, "pin", fc->pin, sizeof(fc->pin));
+        kom_toml_string(fleet, "cpu_max", fc->cpu_max, sizeof(fc->cpu_max));
+        kom_toml_string(fleet, "memory_max", fc->memory_max, sizeof(fc->memory_max));
+        kom_toml_string(fleet, "cgroup_root", fc->cgroup_root, sizeof(fc->cgroup_root));
+    }
+    if (fc->port_step < 1)
+        fc->port_step = 1;
+
+    int found = kom_server_locate(&fc->srv, serve);
+    if (conf)
+        toml_free(conf);
+    return found;
+}
+
+static void fleet_path(char *out, size_t len, int i, const char *file) {
+    if (file)
+        snprintf(out, len, KOM_FLEET_DIR "/instance-%d/%s", i, file);
+    else
+        snprintf(out, len, KOM_FLEET_DIR "/instance-%d", i);
+}
+
+/* dir/name into out, -1 when it does not fit */
+static int fleet_join(char *out, size_t len, const char *dir, const char *name) {
+    int n = snprintf(out, len, "%s/%s", dir, name);
+    return n < 0 || (size_t)n >= len ? -1 : 0;
+}
+
+/* Instances that exist on disk: instance-0 .. instance-(n-1) */
+static int fleet_count(void) {
+    char path[PATH_MAX];
+    struct stat st;
+    int n = 0;
+
+    for (;;) {
+        fleet_path(path, sizeof(path), n, NULL);
+        if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+            return n;
+        n++;
+    }
+}
+
+static int fleet_read_int(int i, const char *file) {
+    char path[PATH_MAX];
+    int value = -1;
+
+    fleet_path(path, sizeof(path), i, file);
+    FILE *fp = fopen(path, "r");
+    if (fp) {
+        if (fscanf(fp, "%d", &value) != 1)
+            value = -1;
+        fclose(fp);
+    }
+    return value;
+}
+
+static int fleet_write_int(int i, const char *file, int value) {
+    char path[PATH_MAX];
+
+    fleet_path(path, sizeof(path), i, file);
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "%d\n", value);
+    return fclose(fp);
+}
+
+/* pid from komodo.pid if that process is still the instance's server */
+static pid_t fleet_pid(const struct fleet_conf *fc, int i) {
+    char link[64], exe[PATH_MAX];
+    pid_t pid = fleet_read_int(i, "komodo.pid");
+
+    if (pid <= 0 || kill(pid, 0) != 0)
+        return 0;
+    snprintf(link, sizeof(link), "/proc/%d/exe", (int)pid);
+    ssize_t n = readlink(link, exe, sizeof(exe) - 1);
+    if (n <= 0)
+        return pid;     /* no /proc access, trust the pidfile */
+    exe[n] = '\0';
+    const char *base = strrchr(exe, '/');
+    return strcmp(base ? base + 1 : exe, fc->srv.binary) == 0 ? pid : 0;
+}
+
+/* ---- materialisation ---- */
+
+static int copy_file(const char *from, const char *to, mode_t mode) {
+    char buf[65536];
+    ssize_t n;
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    int out = in >= 0 ? open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode & 0777) : -1;
+    int err = 0;
+
+    if (out < 0) {
+        if (in >= 0) close(in);
+        return -1;
+    }
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, (size_t)n) != n) {
+            err = -1;
+            break;
+        }
+    }
+    close(in);
+    if (close(out) != 0 || n < 0)
+        err = -1;
+    return err;
+}
+
+static int copy_tree(const char *from, const char *to) {
+    char src[PATH_MAX], dst[PATH_MAX];
+    struct dirent *ent;
+    struct stat st;
+    DIR *dir = opendir(from);
+
+    if (dir == NULL || kom_mkdir_p(to) != 0) {
+        if (dir) closedir(dir);
+        return -1;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+        snprintf(src, sizeof(src), "%s/%s", from, ent->d_name);
+        snprintf(dst, sizeof(dst), "%s/%s", to, ent->d_name);
+        if (lstat(src, &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode)) {
+            copy_tree(src, dst);
+        } else if (S_ISLNK(st.st_mode)) {
+            char target[PATH_MAX];
+            ssize_t n = readlink(src, target, sizeof(target) - 1);
+            if (n > 0) {
+                target[n] = '\0';
+                if (symlink(target, dst) != 0 && errno != EEXIST) {}
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            copy_file(src, dst, st.st_mode);
+        }
+    }
+    closedir(dir);
+    return 0;
+}
+
+static int port_free(int port) {
+    struct sockaddr_in addr = { 0 };
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    int ok;
+
+    if (fd < 0)
+        return 1;
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    ok = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    close(fd);
+    return ok;
+}
+
+/* server.cfg: replace (or append) the "port" line */
+static int rewrite_server_cfg(const char *from, const char *to, int port) {
+    char line[1024];
+    int done = 0;
+    FILE *in = fopen(from, "r");
+    FILE *out;
+
+    if (in == NULL)
+        return 0;   /* open.mp-only package */
+    if ((out = fopen(to, "w")) == NULL) {
+        fclose(in);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), in)) {
+        if (strncmp(line, "port", 4) == 0 && (line[4] == ' ' || line[4] == '\t')) {
+            fprintf(out, "port %d\n", port);
+            done = 1;
+        } else {
+            fputs(line, out);
+        }
+    }
+    if (!done)
+        fprintf(out, "port %d\n", port);
+    fclose(in);
+    return fclose(out);
+}
+
+/* config.json: rewrite the "port" number inside "network" */
+static int rewrite_config_json(const char *from, const char *to, int port) {
+    FILE *in = fopen(from, "r");
+    FILE *out;
+    long len;
+
+    if (in == NULL)
+        return 0;   /* SA-MP package */
+    fseek(in, 0, SEEK_END);
+    len = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    char *json = malloc((size_t)len + 1);
+    if (json == NULL || fread(json, 1, (size_t)len, in) != (size_t)len) {
+        free(json);
+        fclose(in);
+        return -1;
+    }
+    json[len] = '\0';
+    fclose(in);
+
+    char *net = strstr(json, "\"network\"");
+    char *key = strstr(net ? net : json, "\"port\"");
+    char *num = key ? strchr(key + 6, ':') : NULL;
+
+    if ((out = fopen(to, "w")) == NULL) {
+        free(json);
+        return -1;
+    }
+    if (num) {
+        num++;
+        while (*num == ' ' || *num == '\t') num++;
+        char *end = num;
+        while (*end >= '0' && *end <= '9') end++;
+        fwrite(json, 1, (size_t)(num - json), out);
+        fprintf(out, "%d", port);
+        fputs(end, out);
+    } else {
+        fputs(json, out);
+    }
+    free(json);
+    return fclose(out);
+}
+
+static int fleet_create(struct fleet_conf *fc, int count) {
+    char src[PATH_MAX], from[PATH_MAX], to[PATH_MAX];
+    int port = fc->base_port;
+
+    if (realpath(fc->srv.dir, src) == NULL) {
+        perror("[err]: fleet");
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        DIR *dir;
+        struct dirent *ent;
+        struct stat st;
+
+        fleet_path(to, sizeof(to), i, NULL);
+        if (kom_mkdir_p(to) != 0 || (dir = opendir(src)) == NULL) {
+            perror("[err]: fleet");
+            return 1;
+        }
+        while ((ent = readdir(dir)) != NULL) {
+            int private = ent->d_name[0] == '.';
+            for (int p = 0; __fleet_private[p] && !private; p++)
+                private = strcmp(ent->d_name, __fleet_private[p]) == 0;
+            if (private)
+                continue;
+            if (fleet_join(from, sizeof(from), src, ent->d_name) != 0)
+                continue;
+            fleet_path(to, sizeof(to), i, ent->d_name);
+            if (lstat(to, &st) != 0 && symlink(from, to) != 0)
+                fprintf(stderr, "[err]: fleet: %s: %s\n", to, strerror(errno));
+        }
+        closedir(dir);
+
+        fleet_path(to, sizeof(to), i, "scriptfiles");
+        if (fleet_join(from, sizeof(from), src, "scriptfiles") == 0 && stat(from, &st) == 0 && stat(to, &st) != 0)
+            copy_tree(from, to);
+
+        /* keep a running instance's port, otherwise take the next free one */
+        int cur = fleet_read_int(i, "komodo.port");
+        if (cur > 0 && fleet_pid(fc, i) > 0) {
+            port = cur;
+        } else {
+            while (port < 65535 && !port_free(port))
+                port += fc->port_step;
+        }
+
+        fleet_path(to, sizeof(to), i, "server.cfg");
+        int err = fleet_join(from, sizeof(from), src, "server.cfg") != 0 ||
+                  rewrite_server_cfg(from, to, port) != 0;
+        fleet_path(to, sizeof(to), i, "config.json");
+        err |= fleet_join(from, sizeof(from), src, "config.json") != 0 ||
+               rewrite_config_json(from, to, port) != 0;
+        err |= fleet_write_int(i, "komodo.port", port);
+        if (err) {
+            printf_color(COL_RED, "fleet: instance-%d: failed to write config", i);
+            return 1;
+        }
+
+        println("  instance-%d  port %d", i, port);
+        port += fc->port_step;
+    }
+
+    printf_color(COL_GREEN, "fleet: %d instances in " KOM_FLEET_DIR "/", count);
+    return 0;
+}
+
+/* ---- placement ---- */
+
+static int parse_cpulist(const char *list, cpu_set_t *set) {
+    int n = 0;
+    const char *p = list;
+
+    CPU_ZERO(set);
+    while (*p) {
+        char *end;
+        long a = strtol(p, &end, 10), b;
+        if (end == p)
+            break;
+        b = a;
+        if (*end == '-')
+            b = strtol(end + 1, &end, 10);
+        for (long c = a; c <= b && c < CPU_SETSIZE; c++) {
+            CPU_SET((int)c, set);
+            n++;
+        }
+        p = *end == ',' ? end + 1 : end;
+        if (*p == '\n')
+            break;
+    }
+    return n;
+}
+
+static int fleet_ncpu(cpu_set_t *allowed) {
+    if (sched_getaffinity(0, sizeof(*allowed), allowed) != 0)
+        return 0;
+    return CPU_COUNT(allowed);
+}
+
+/*
+ * Instances out of count that pin = "core" puts on instance i's core:
+ * 1 while there are enough cores, more once they wrap around.
+ */
+static int fleet_core_share(const struct fleet_conf *fc, int i, int count) {
+    cpu_set_t allowed;
+    int ncpu = fleet_ncpu(&allowed);
+
+    if (strcmp(fc->pin, "core") != 0 || ncpu <= 0 || count <= ncpu)
+        return 1;
+    return count / ncpu + (i % ncpu < count % ncpu);
+}
+
+static void fleet_warn_sharing(const struct fleet_conf *fc, int count) {
+    cpu_set_t allowed;
+    int ncpu = fleet_ncpu(&allowed);
+
+    if (strcmp(fc->pin, "core") == 0 && ncpu > 0 && count > ncpu)
+        printf_color(COL_YELLOW, "fleet: %d instances on %d usable cores, cores are shared", count, ncpu);
+}
+
+/*
+ * CPU set (and NUMA node, or -1) for instance i: a single core from the
+ * CPUs komodo itself may use, or every core of one NUMA node.
+ */
+static int fleet_placement(const struct fleet_conf *fc, int i, cpu_set_t *set, int *node) {
+    cpu_set_t allowed;
+
+    *node = -1;
+    if (strcmp(fc->pin, "none") == 0)
+        return 0;
+
+    if (strcmp(fc->pin, "numa") == 0) {
+        char path[128], list[1024];
+        int nodes = 0;
+        for (;; nodes++) {
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", nodes);
+            if (access(path, F_OK) != 0)
+                break;
+        }
+        if (nodes > 0) {
+            *node = i % nodes;
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", *node);
+            FILE *fp = fopen(path, "r");
+            if (fp && fgets(list, sizeof(list), fp) && parse_cpulist(list, set) > 0) {
+                fclose(fp);
+                return 1;
+            }
+            if (fp) fclose(fp);
+        }
+        *node = -1;     /* no NUMA info: fall back to per-core */
+    }
+
+    int ncpu = fleet_ncpu(&allowed);
+    if (ncpu <= 0)
+        return 0;
+    for (int c = 0, k = 0; c < CPU_SETSIZE; c++) {
+        if (!CPU_ISSET(c, &allowed))
+            continue;
+        if (k++ == i % ncpu) {
+            CPU_ZERO(set);
+            CPU_SET(c, set);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int write_text(const char *path, const char *text) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = write(fd, text, strlen(text));
+    close(fd);
+    return n == (ssize_t)strlen(text) ? 0 : -1;
+}
+
+/* cgroup v2 group with cpu.max / memory.max for instance i, "" when unused */
+static void fleet_cgroup(const struct fleet_conf *fc, int i, char *out, size_t len) {
+    char path[PATH_MAX], parent[PATH_MAX];
+
+    out[0] = '\0';
+    if (!fc->cpu_max[0] && !fc->memory_max[0])
+        return;
+
+    snprintf(parent, sizeof(parent), "%s", fc->cgroup_root);
+    char *slash = strrchr(parent, '/');
+    if (slash && slash != parent) {
+        *slash = '\0';
+        if (fleet_join(path, sizeof(path), parent, "cgroup.subtree_control") == 0)
+            write_text(path, "+cpu +memory");
+    }
+    if (kom_mkdir_p(fc->cgroup_root) != 0) {
+        printf_color(COL_YELLOW, "fleet: %s: %s, running without limits", fc->cgroup_root, strerror(errno));
+        return;
+    }
+    if (fleet_join(path, sizeof(path), fc->cgroup_root, "cgroup.subtree_control") == 0)
+        write_text(path, "+cpu +memory");
+
+    snprintf(out, len, "%s/instance-%d", fc->cgroup_root, i);
+    kom_mkdir_p(out);
+    if (fc->cpu_max[0]) {
+        snprintf(path, sizeof(path), "%s/cpu.max", out);
+        if (write_text(path, fc->cpu_max) != 0)
+            printf_color(COL_YELLOW, "fleet: instance-%d: cannot set cpu.max", i);
+    }
+    if (fc->memory_max[0]) {
+        snprintf(path, sizeof(path), "%s/memory.max", out);
+        if (write_text(path, fc->memory_max) != 0)
+            printf_color(COL_YELLOW, "fleet: instance-%d: cannot set memory.max", i);
+    }
+}
+
+/* ---- lifecycle ---- */
+
+/*
+ * Start instance i detached (double fork, own session) with its console
+ * in console.log. The log is truncated before forking, so whatever is in
+ * it once the pid is known comes from this run. Placement happens in the
+ * child right before execve.
+ */
+static pid_t fleet_spawn(const struct fleet_conf *fc, int i) {
+    char dir[PATH_MAX], cgroup[PATH_MAX], path[PATH_MAX];
+    cpu_set_t set;
+    int node, pinned, pp[2], log;
+    pid_t pid, server = 0;
+
+    fleet_path(dir, sizeof(dir), i, NULL);
+    pinned = fleet_placement(fc, i, &set, &node);
+    fleet_cgroup(fc, i, cgroup, sizeof(cgroup));
+
+    fleet_path(path, sizeof(path), i, "console.log");
+    log = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (log < 0)
+        return -1;
+    if (pipe2(pp, O_CLOEXEC) != 0) {
+        close(log);
+        return -1;
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        close(log);
+        close(pp[0]);
+        close(pp[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        setsid();
+        pid_t gc = fork();
+        if (gc != 0) {
+            if (write(pp[1], &gc, sizeof(gc)) != sizeof(gc)) {}
+            _exit(0);
+        }
+
+        if (chdir(dir) != 0)
+            _exit(127);
+        int devnull = open("/dev/null", O_RDONLY);
+        if (devnull >= 0) dup2(devnull, STDIN_FILENO);
+        dup2(log, STDOUT_FILENO);
+        dup2(log, STDERR_FILENO);
+
+        if (cgroup[0]) {
+            char procs[PATH_MAX];
+            snprintf(procs, sizeof(procs), "%s/cgroup.procs", cgroup);
+            if (write_text(procs, "0") != 0)
+                fprintf(stderr, "komodo: cannot join %s\n", cgroup);
+        }
+        if (pinned && sched_setaffinity(0, sizeof(set), &set) != 0)
+            perror("komodo: sched_setaffinity");
+#ifdef SYS_set_mempolicy
+        if (node >= 0 && node < (int)(sizeof(unsigned long) * 8)) {
+            unsigned long mask = 1UL << node;
+            syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8);
+        }
+#endif
+
+        char exe[160];
+        snprintf(exe, sizeof(exe), "./%s", fc->srv.binary);
+        execl(exe, fc->srv.binary, (char *)NULL);
+        _exit(127);
+    }
+
+    close(log);
+    close(pp[1]);
+    if (read(pp[0], &server, sizeof(server)) != sizeof(server))
+        server = -1;
+    close(pp[0]);
+    waitpid(pid, NULL, 0);
+
+    if (server > 0)
+        fleet_write_int(i, "komodo.pid", server);
+    return server;
+}
+
+static int fleet_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static void fleet_stop_one(const struct fleet_conf *fc, int i) {
+    char path[PATH_MAX];
+    pid_t pid = fleet_pid(fc, i);
+
+    fleet_path(path, sizeof(path), i, "komodo.pid");
+    if (pid <= 0) {
+        unlink(path);
+        return;
+    }
+
+    int pfd = fleet_pidfd(pid);
+    kill(pid, SIGTERM);
+    if (pfd >= 0) {
+        struct pollfd p = { .fd = pfd, .events = POLLIN };
+        if (poll(&p, 1, FLEET_STOP_GRACE_MS) == 0)
+            kill(pid, SIGKILL);
+        close(pfd);
+    } else {
+        for (int t = 0; t < FLEET_STOP_GRACE_MS / 100 && kill(pid, 0) == 0; t++)
+            usleep(100000);
+        if (kill(pid, 0) == 0)
+            kill(pid, SIGKILL);
+    }
+    unlink(path);
+}
+
+/*
+ * Wait for the ready marker in instance i's console.log, woken by
+ * inotify on writes and by the pidfd if the server dies first. Only
+ * output written after the spawn counts: if the log shrinks or is
+ * replaced under us, scanning restarts from the new file's start.
+ */
+static int fleet_wait_ready(const struct fleet_conf *fc, int i, pid_t pid) {
+    char path[PATH_MAX], buf[4096], carry[256] = "";
+    struct timespec t0, t1;
+    off_t off = 0;
+    ino_t ino_seen = 0;
+    int ino = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    int pfd = fleet_pidfd(pid);
+    int ready = 0;
+
+    fleet_path(path, sizeof(path), i, "console.log");
+    if (ino >= 0)
+        inotify_add_watch(ino, path, IN_MODIFY);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (;;) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            struct stat st;
+            ssize_t n;
+            if (fstat(fd, &st) == 0 && (st.st_ino != ino_seen || st.st_size < off)) {
+                ino_seen = st.st_ino;
+                off = 0;
+                carry[0] = '\0';
+            }
+            while ((n = pread(fd, buf, sizeof(buf) - 1, off)) > 0) {
+                buf[n] = '\0';
+                off += n;
+                /* keep a tail so a marker split across reads still matches */
+                char joined[sizeof(carry) + sizeof(buf)];
+                snprintf(joined, sizeof(joined), "%s%s", carry, buf);
+                if (strcasestr(joined, fc->srv.ready)) {
+                    ready = 1;
+                    break;
+                }
+                size_t jl = strlen(joined);
+                snprintf(carry, sizeof(carry), "%s", joined + (jl > sizeof(carry) - 1 ? jl - (sizeof(carry) - 1) : 0));
+            }
+            close(fd);
+        }
+        if (ready || kill(pid, 0) != 0)
+            break;
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        long waited = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+        if (waited >= FLEET_READY_MS)
+            break;
+
+        struct pollfd p[2] = { { .fd = ino, .events = POLLIN }, { .fd = pfd, .events = POLLIN } };
+        poll(p, 2, ino >= 0 ? (int)(FLEET_READY_MS - waited) : 200);
+        if (ino >= 0) {
+            char ev[4096];
+            while (read(ino, ev, sizeof(ev)) > 0) {}
+        }
+        if (p[1].revents & POLLIN)
+            break;      /* server exited */
+    }
+
+    if (ino >= 0) close(ino);
+    if (pfd >= 0) close(pfd);
+    return ready ? 0 : -1;
+}
+
+static void fleet_describe(const struct fleet_conf *fc, int i, int count, pid_t pid) {
+    cpu_set_t set;
+    int node, port = fleet_read_int(i, "komodo.port");
+    int share = fleet_core_share(fc, i, count);
+    char where[64] = "floating";
+
+    if (fleet_placement(fc, i, &set, &node)) {
+        if (node >= 0)
+            snprintf(where, sizeof(where), "node %d", node);
+        else
+            for (int c = 0; c < CPU_SETSIZE; c++)
+                if (CPU_ISSET(c, &set)) {
+                    if (share > 1)
+                        snprintf(where, sizeof(where), "cpu %d x%d", c, share);
+                    else
+                        snprintf(where, sizeof(where), "cpu %d", c);
+                    break;
+                }
+    }
+    if (pid > 0)
+        println("  instance-%-3d port %-5d %-9s pid %d", i, port, where, (int)pid);
+    else
+        println("  instance-%-3d port %-5d %-9s stopped", i, port, where);
+}
+
+static int fleet_start(const struct fleet_conf *fc, int count) {
+    int failed = 0;
+
+    fleet_warn_sharing(fc, count);
+    for (int i = 0; i < count; i++) {
+        pid_t pid = fleet_pid(fc, i);
+        if (pid <= 0 && (pid = fleet_spawn(fc, i)) <= 0) {
+            printf_color(COL_RED, "fleet: instance-%d failed to start", i);
+            failed++;
+            continue;
+        }
+        fleet_describe(fc, i, count, pid);
+    }
+    return failed != 0;
+}
+
+/* One instance at a time, each back up before the next goes down */
+static int fleet_rolling_restart(const struct fleet_conf *fc, int count) {
+    for (int i = 0; i < count; i++) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        fleet_stop_one(fc, i);
+        pid_t pid = fleet_spawn(fc, i);
+        if (pid <= 0 || fleet_wait_ready(fc, i, pid) != 0) {
+            printf_color(COL_RED, "fleet: instance-%d did not come back, stopping the rollout", i);
+            return 1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        println("  instance-%-3d restarted in %.0f ms (pid %d)", i,
+                (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6, (int)pid);
+    }
+    printf_color(COL_GREEN, "fleet: rolling restart done");
+    return 0;
+}
+
+/* `fleet create [N] | start | stop | restart | status` */
+int call_fleet(const char *args) {
+    struct fleet_conf fc;
+    char verb[32] = "";
+    int n = 0;
+
+    while (*args == ' ') args++;
+    sscanf(args, "%31s %d", verb, &n);
+
+    if (fleet_load_conf(&fc) != 0) {
+        printf_color(COL_RED, "fleet: no samp03svr/omp-server found, run \"gamemode\" first or set [serve] dir/binary");
+        return 1;
+    }
+
+    if (strcmp(verb, "create") == 0) {
+        int count = n > 0 ? n : fc.instances;
+        if (count > KOM_FLEET_MAX)
+            count = KOM_FLEET_MAX;
+        return fleet_create(&fc, count);
+    }
+
+    int count = fleet_count();
+    if (count == 0 && verb[0]) {
+        println("fleet: no instances, run \"fleet create\" first");
+        return 1;
+    }
+
+    if (strcmp(verb, "start") == 0) {
+        return fleet_start(&fc, count);
+    } else if (strcmp(verb, "stop") == 0) {
+        for (int i = 0; i < count; i++)
+            fleet_stop_one(&fc, i);
+        printf_color(COL_GREEN, "fleet: %d instances stopped", count);
+        return 0;
+    } else if (strcmp(verb, "restart") == 0) {
+        return fleet_rolling_restart(&fc, count);
+    } else if (strcmp(verb, "status") == 0) {
+        fleet_warn_sharing(&fc, count);
+        for (int i = 0; i < count; i++)
+            fleet_describe(&fc, i, count, fleet_pid(&fc, i));
+        return 0;
+    }
+
+    println("usage: fleet create [<n>] | start | stop | restart | status");
+    return 1;
+}
@@ -0,0 +1,19 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/fleet.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef FLEET_H
+#define FLEET_H
+
+#define KOM_FLEET_DIR   "fleet"
+#define KOM_FLEET_MAX   256
+
+int call_fleet(const char *args);
+
+#endif
@@ -7,8 +7,8 @@
  * See the LICENSE file for details.
  *
  * Compile with GCC or CLANG
- * gcc -D_GNU_SOURCE -g -Os -s komodo.c utils.c package.c tomlc99/toml.c -o komodo -lm -lcurl -lncurses -lreadline -lz -lzip -larchive
- * clang -D_GNU_SOURCE -g -Os -s komodo.c utils.c package.c tomlc99/toml.c -o komodo -lm -lcurl -lncurses -lreadline -lz -lzip -larchive
+ * gcc -D_GNU_SOURCE -g -Os -s komodo.c utils.c package.c progress.c prefetch.c sha256.c deps.c serve.c fleet.c rcon.c watch.c query.c logs.c amx.c snapshot.c tomlc99/toml.c -o komodo -lm -lcurl -lncurses -ltinfo -lreadline -lz -lzip -larchive -lpthread
+ * clang -D_GNU_SOURCE -g -Os -s komodo.c utils.c package.c progress.c prefetch.c sha256.c deps.c serve.c fleet.c rcon.c watch.c query.c logs.c amx.c snapshot.c tomlc99/toml.c -o komodo -lm -lcurl -lncurses -ltinfo -lreadline -lz -lzip -larchive -lpthread
  *
  */
 
@@ -45,6 +45,16 @@ static inline int komo_sys(const char *cmd) {
 #include "color.h"
 #include "utils.h"
 #include "package.h"
+#include "prefetch.h"
+#include "deps.h"
+#include "serve.h"
+#include "fleet.h"
+#include "watch.h"
+#include "query.h"
+#include "rcon.h"
+#include "logs.h"
+#include "amx.h"
+#include "snapshot.h"
 
 int komodo_title(
     const char *custom_title)
@@ -78,7 +88,8 @@ void _komodo_ () {
     /* valid commands. */
         {
             "exit", "clear", "kill", "title", "help",
-            "gamemode", "pawncc"
+            "gamemode", "pawncc", "install", "serve", "fleet", "watch",
+            "query", "rcon", "logs", "amx", "snapshot", "restore"
         };
     int num_cmds = 
         sizeof(__vcommands__) / 
@@ -129,7 +140,8 @@ void _komodo_ () {
                 println("usage: help | help [<cmds>]");
                 println("cmds:");
                 println(" clear, exit, kill, title");
-                println(" gamemode, pawncc");
+                println(" gamemode, pawncc, install, serve, fleet, watch, query, rcon, logs, amx");
+                println(" snapshot, restore");
             } else if (strcmp(arg, "exit") == 0) {
                 println("exit: exit from Komodo. | \
 Usage: \"exit\"");
@@ -142,6 +154,36 @@ Usage: \"kill\"");
             } else if (strcmp(arg, "title") == 0) {
                 println("title: set-title Terminal Komodo. | \
 Usage: \"title\" | [<args>]");
+            } else if (strcmp(arg, "install") == 0) {
+                println("install: install [dependencies] from komodo.toml. | \
+Usage: \"install\" | [<update>]");
+            } else if (strcmp(arg, "serve") == 0) {
+                println("serve: run the server, restart it on crash. | \
+Usage: \"serve\" | [serve] in komodo.toml");
+            } else if (strcmp(arg, "fleet") == 0) {
+                println("fleet: run many pinned server instances. | \
+Usage: \"fleet\" | [<create [n]|start|stop|restart|status>]");
+            } else if (strcmp(arg, "watch") == 0) {
+                println("watch: recompile and reload scripts on save. | \
+Usage: \"watch\" | [watch] in komodo.toml");
+            } else if (strcmp(arg, "query") == 0) {
+                println("query: poll servers with the SA-MP query protocol. | \
+Usage: \"query\" | [<host:port ...>] [<json|prom> <file>]");
+            } else if (strcmp(arg, "rcon") == 0) {
+                println("rcon: run rcon commands on every server at once. | \
+Usage: \"rcon\" | <command>[; <command> ...]");
+            } else if (strcmp(arg, "logs") == 0) {
+                println("logs: summarise crashes and errors in the server log. | \
+Usage: \"logs\" | [follow] [reset] [<file ...>]");
+            } else if (strcmp(arg, "amx") == 0) {
+                println("amx: report and diff compiled .amx sizes. | \
+Usage: \"amx\" | [<file.amx ...>] [amx] in komodo.toml");
+            } else if (strcmp(arg, "snapshot") == 0) {
+                println("snapshot: back up scriptfiles, configs and databases. | \
+Usage: \"snapshot\" | [full]");
+            } else if (strcmp(arg, "restore") == 0) {
+                println("restore: restore a snapshot and verify its hashes. | \
+Usage: \"restore\" | [<id> [<dest>]]");
             } else {
                 println("help not found for: '%s'", arg);
             }
@@ -150,6 +192,9 @@ Usage: \"title\" | [<args>]");
         } else if (strcmp(ptr_cmds, "pawncc") == 0) {
             komodo_title("Komodo Toolchain | @ pawncc");
 
+            /* start warming up for the configured OS before the first prompt */
+            kom_prefetch_start("pawncc", komodo_os);
+
             char platform;
             printf("Select platform:\n");
             printf("[L/l] Linux\n");
@@ -163,12 +208,16 @@ Usage: \"title\" | [<args>]");
                 call_download_pawncc("windows");
             } else {
                 printf("Invalid platform selection.\n");
+                kom_prefetch_cancel();
             }
 
             continue;
         } else if (strcmp(ptr_cmds, "gamemode") == 0) {
             komodo_title("Komodo Toolchain | @ gamemode");
 
+            /* start warming up for the configured OS before the first prompt */
+            kom_prefetch_start("samp", komodo_os);
+
             char platform;
             printf("Select platform:\n");
             printf("[L/l] Linux\n");
@@ -182,8 +231,81 @@ Usage: \"title\" | [<args>]");
                 call_download_samp("windows");
             } else {
                 printf("Invalid platform selection.\n");
+                kom_prefetch_cancel();
             }
 
+            continue;
+        } else if (strncmp(ptr_cmds, "install", 7) == 0 &&
+                   (ptr_cmds[7] == '\0' || ptr_cmds[7] == ' ')) {
+            komodo_title("Komodo Toolchain | @ install");
+
+            char *arg = ptr_cmds + 7;
+            while (*arg == ' ') arg++;
+
+            /* "install update" ignores komodo.lock and resolves again */
+            call_deps_install(strcmp(arg, "update") == 0);
+
+            continue;
+        } else if (strcmp(ptr_cmds, "serve") == 0) {
+            komodo_title("Komodo Toolchain | @ serve");
+
+            call_serve();
+
+            continue;
+        } else if (strncmp(ptr_cmds, "fleet", 5) == 0 &&
+                   (ptr_cmds[5] == '\0' || ptr_cmds[5] == ' ')) {
+            komodo_title("Komodo Toolchain | @ fleet");
+
+            call_fleet(ptr_cmds + 5);
+
+            continue;
+        } else if (strcmp(ptr_cmds, "watch") == 0) {
+            komodo_title("Komodo Toolchain | @ watch");
+
+            call_watch();
+
+            continue;
+        } else if (strncmp(ptr_cmds, "query", 5) == 0 &&
+                   (ptr_cmds[5] == '\0' || ptr_cmds[5] == ' ')) {
+            komodo_title("Komodo Toolchain | @ query");
+
+            call_query(ptr_cmds + 5);
+
+            continue;
+        } else if (strncmp(ptr_cmds, "rcon", 4) == 0 &&
+                   (ptr_cmds[4] == '\0' || ptr_cmds[4] == ' ')) {
+            komodo_title("Komodo Toolchain | @ rcon");
+
+            call_rcon(ptr_cmds + 4);
+
+            continue;
+        } else if (strncmp(ptr_cmds, "logs", 4) == 0 &&
+                   (ptr_cmds[4] == '\0' || ptr_cmds[4] == ' ')) {
+            komodo_title("Komodo Toolchain | @ logs");
+
+            call_logs(ptr_cmds + 4);
+
+            continue;
+        } else if (strncmp(ptr_cmds, "amx", 3) == 0 &&
+                   (ptr_cmds[3] == '\0' || ptr_cmds[3] == ' ')) {
+            komodo_title("Komodo Toolchain | @ amx");
+
+            call_amx(ptr_cmds + 3);
+
+            continue;
+        } else if (strncmp(ptr_cmds, "snapshot", 8) == 0 &&
+                   (ptr_cmds[8] == '\0' || ptr_cmds[8] == ' ')) {
+            komodo_title("Komodo Toolchain | @ snapshot");
+
+            call_snapshot(ptr_cmds + 8);
+
+            continue;
+        } else if (strncmp(ptr_cmds, "restore", 7) == 0 &&
+                   (ptr_cmds[7] == '\0' || ptr_cmds[7] == ' ')) {
+            komodo_title("Komodo Toolchain | @ restore");
+
+            call_restore(ptr_cmds + 7);
+
             continue;
         } else if (strcmp(ptr_cmds, "clear") == 0) {
             komodo_title("Komodo Toolchain | @ clear");
@@ -242,6 +364,8 @@ int main(void) {
     /* main is not using. */
     /// @ load komodo.toml
     kom_toml_data();
+    /// @ libcurl, once for the whole session.
+    curl_global_init(CURL_GLOBAL_DEFAULT);
     /// @ komodo commands call.
     _komodo_();
     return 0;
@@ -0,0 +1,756 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/logs.c
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <limits.h>
+#include <libgen.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "color.h"
+#include "utils.h"
+#include "serve.h"
+#include "logs.h"
+
+/*
+ * `logs`: crash and error summary of server_log.txt / log.txt.
+ *
+ * Files are mmapped and scanned 32 bytes at a time for newlines and for
+ * the first two bytes of each keyword ("[d"ebug, "Ru"n time error,
+ * "Wa"rning) with AVX2 or SSE2 when the CPU has them; only the lines
+ * with a keyword candidate are looked at further. crashdetect reports
+ * (a "Run time error" or "Server crashed" line followed by its backtrace)
+ * are folded into one signature - error text plus frames, with argument
+ * values stripped - and counted with first/last timestamps. Warnings are
+ * grouped with their numbers and quoted strings masked out.
+ *
+ * The groups and a per-file byte offset are kept in KOM_LOGS_STATE, so
+ * each run only reads what was appended since the last one; a file whose
+ * inode changed or that got shorter is read again from the start.
+ */
+
+#define LOGS_FILES      16
+#define LOGS_FRAMES     8
+#define LOGS_SIG        1024
+#define LOGS_TS         40
+#define LOGS_TOP        20
+#define LOGS_IDLE_MS    300
+
+struct logs_group {
+    uint64_t hash;
+    char kind;                  /* 'C' crash, 'E' run time error, 'W' warning */
+    long count;
+    long fresh;                 /* hits during this run */
+    char first[LOGS_TS], last[LOGS_TS];
+    char *sig;
+};
+
+struct logs_file {
+    char path[PATH_MAX];
+    dev_t dev;
+    ino_t ino;
+    off_t offset;
+};
+
+struct logs_ctx {
+    void (*block)(const unsigned char *p, uint32_t *nl, uint32_t *kw);
+    const char *isa;
+
+    struct logs_group *groups;
+    size_t ngroups, capgroups;
+    int *slots;                 /* open addressing, index + 1 into groups */
+    size_t nslots;
+
+    struct logs_file files[LOGS_FILES];
+    int nfiles;
+
+    /* crashdetect report being assembled */
+    int open;
+    const char *event_line;     /* its first line in the current mapping */
+    char kind;
+    char ts[LOGS_TS];
+    char sig[LOGS_SIG];
+    int frames;
+
+    int live;                   /* follow mode: echo matching lines */
+    unsigned long long bytes, lines;
+};
+
+/* ---- vectorised block scan ---- */
+
+static const char logs_pairs[][2] = { { '[', 'd' }, { 'R', 'u' }, { 'W', 'a' } };
+static const char *logs_needles[] = { "[debug]", "Run time error", "Warning" };
+
+/*
+ * For 32 bytes at p set bit i of *nl when p[i] is a newline and bit i of
+ * *kw when p[i], p[i + 1] start a keyword; p[32] must be readable.
+ */
+static void logs_block_scalar(const unsigned char *p, uint32_t *nl, uint32_t *kw) {
+    *nl = *kw = 0;
+    for (int i = 0; i < 32; i++) {
+        if (p[i] == '\n')
+            *nl |= 1u << i;
+        for (int k = 0; k < 3; k++) {
+            if (p[i] == (unsigned char)logs_pairs[k][0] && p[i + 1] == (unsigned char)logs_pairs[k][1])
+                *kw |= 1u << i;
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void logs_block_sse2(const unsigned char *p, uint32_t *nl, uint32_t *kw) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    uint32_t n = 0, k = 0;
+
+    for (int half = 0; half < 2; half++) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + half * 16));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + half * 16 + 1));
+        __m128i hit = _mm_setzero_si128();
+        for (int i = 0; i < 3; i++) {
+            hit = _mm_or_si128(hit, _mm_and_si128(
+                _mm_cmpeq_epi8(a, _mm_set1_epi8(logs_pairs[i][0])),
+                _mm_cmpeq_epi8(b, _mm_set1_epi8(logs_pairs[i][1]))));
+        }
+        n |= (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, newline)) << (half * 16);
+        k |= (uint32_t)_mm_movemask_epi8(hit) << (half * 16);
+    }
+    *nl = n;
+    *kw = k;
+}
+
+__attribute__((target("avx2")))
+static void logs_block_avx2(const unsigned char *p, uint32_t *nl, uint32_t *kw) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)p);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(p + 1));
+    __m256i hit = _mm256_setzero_si256();
+
+    for (int i = 0; i < 3; i++) {
+        hit = _mm256_or_si256(hit, _mm256_and_si256(
+            _mm256_cmpeq_epi8(a, _mm256_set1_epi8(logs_pairs[i][0])),
+            _mm256_cmpeq_epi8(b, _mm256_set1_epi8(logs_pairs[i][1]))));
+    }
+    *nl = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, _mm256_set1_epi8('\n')));
+    *kw = (uint32_t)_mm256_movemask_epi8(hit);
+}
+#endif
+
+static void logs_pick_block(struct logs_ctx *c) {
+    c->block = logs_block_scalar;
+    c->isa = "scalar";
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        c->block = logs_block_avx2;
+        c->isa = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        c->block = logs_block_sse2;
+        c->isa = "sse2";
+    }
+#endif
+}
+
+/* ---- groups ---- */
+
+static uint64_t logs_hash(char kind, const char *sig) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ (unsigned char)kind;
+    for (; *sig; sig++)
+        h = (h ^ (unsigned char)*sig) * 0x100000001b3ULL;
+    return h;
+}
+
+static int logs_rehash(struct logs_ctx *c, size_t nslots) {
+    int *slots = calloc(nslots, sizeof(int));
+    if (slots == NULL)
+        return -1;
+    for (size_t i = 0; i < c->ngroups; i++) {
+        size_t s = c->groups[i].hash & (nslots - 1);
+        while (slots[s])
+            s = (s + 1) & (nslots - 1);
+        slots[s] = (int)i + 1;
+    }
+    free(c->slots);
+    c->slots = slots;
+    c->nslots = nslots;
+    return 0;
+}
+
+static struct logs_group *logs_group(struct logs_ctx *c, char kind, const char *sig) {
+    uint64_t h = logs_hash(kind, sig);
+
+    if ((c->ngroups + 1) * 2 > c->nslots && logs_rehash(c, c->nslots ? c->nslots * 2 : 1024) != 0)
+        return NULL;
+
+    size_t s = h & (c->nslots - 1);
+    while (c->slots[s]) {
+        struct logs_group *g = &c->groups[c->slots[s] - 1];
+        if (g->hash == h && g->kind == kind && strcmp(g->sig, sig) == 0)
+            return g;
+        s = (s + 1) & (c->nslots - 1);
+    }
+
+    if (c->ngroups == c->capgroups) {
+        size_t cap = c->capgroups ? c->capgroups * 2 : 256;
+        struct logs_group *g = realloc(c->groups, cap * sizeof(*g));
+        if (g == NULL)
+            return NULL;
+        c->groups = g;
+        c->capgroups = cap;
+    }
+    struct logs_group *g = &c->groups[c->ngroups];
+    memset(g, 0, sizeof(*g));
+    g->hash = h;
+    g->kind = kind;
+    g->sig = strdup(sig);
+    c->slots[s] = (int)++c->ngroups;
+    return g;
+}
+
+static void logs_hit(struct logs_ctx *c, char kind, const char *sig, const char *ts) {
+    struct logs_group *g = logs_group(c, kind, sig);
+    if (g == NULL)
+        return;
+    if (g->count == 0)
+        snprintf(g->first, sizeof(g->first), "%s", ts[0] ? ts : "-");
+    snprintf(g->last, sizeof(g->last), "%s", ts[0] ? ts : "-");
+    g->count++;
+    g->fresh++;
+
+    if (c->live && kind != 'W') {
+        printf_color(COL_RED, "logs: %s (%ld%s)", g->sig, g->count,
+                     g->count == 1 ? ", new signature" : "");
+    }
+}
+
+/* ---- line handling ---- */
+
+static void logs_event_close(struct logs_ctx *c) {
+    if (c->open)
+        logs_hit(c, c->kind, c->sig, c->ts);
+    c->open = 0;
+}
+
+static void logs_event_open(struct logs_ctx *c, char kind, const char *ts, const char *msg, size_t len) {
+    logs_event_close(c);
+    c->open = 1;
+    c->kind = kind;
+    c->frames = 0;
+    snprintf(c->ts, sizeof(c->ts), "%s", ts);
+    snprintf(c->sig, sizeof(c->sig), "%.*s", (int)len, msg);
+}
+
+/* "#0 000a1b2c in public OnFoo (playerid=3) at gm.pwn:12" -> "public OnFoo at gm.pwn:12" */
+static void logs_frame(struct logs_ctx *c, const char *msg, size_t len) {
+    const char *in = memmem(msg, len, " in ", 4);
+    size_t used = strlen(c->sig);
+    int depth = 0;
+
+    if (in == NULL || c->frames >= LOGS_FRAMES || used + 4 >= sizeof(c->sig))
+        return;
+    c->frames++;
+    used += (size_t)snprintf(c->sig + used, sizeof(c->sig) - used, " < ");
+
+    for (const char *p = in + 4; p < msg + len && used + 1 < sizeof(c->sig); p++) {
+        if (*p == '(') {
+            depth++;
+            continue;
+        }
+        if (*p == ')' && depth > 0) {
+            depth--;
+            continue;
+        }
+        if (depth > 0 || (*p == ' ' && (used == 0 || c->sig[used - 1] == ' ')))
+            continue;
+        c->sig[used++] = *p == '\t' ? ' ' : *p;
+    }
+    while (used > 0 && c->sig[used - 1] == ' ')
+        used--;
+    c->sig[used] = '\0';
+}
+
+/*
+ * Warnings mostly differ in their arguments: 'Warning: player 12 name "Bob"'
+ * and 'Warning: player 7 name "Al"' both become 'Warning: player # name "*"'.
+ * sig must hold LOGS_SIG bytes.
+ */
+static void logs_warning_sig(char *sig, const char *msg, size_t len) {
+    const char *end = msg + len;
+    size_t used = 0;
+
+    for (const char *p = msg; p < end && used + 4 < LOGS_SIG; p++) {
+        if (*p == '"') {
+            const char *close = p + 1;
+            while (close < end && *close != '"')
+                close += *close == '\\' ? 2 : 1;
+            if (close >= end)
+                close = end - 1;
+            memcpy(sig + used, "\"*\"", 3);
+            used += 3;
+            p = close;
+        } else if (isdigit((unsigned char)*p) &&
+                   (p == msg || !(isalnum((unsigned char)p[-1]) || p[-1] == '_'))) {
+            sig[used++] = '#';
+            while (p + 1 < end && (isalnum((unsigned char)p[1]) || p[1] == '.'))
+                p++;
+        } else {
+            sig[used++] = *p == '\t' ? ' ' : *p;
+        }
+    }
+    sig[used] = '\0';
+}
+
+static void logs_line(struct logs_ctx *c, const char *line, size_t len) {
+    char ts[LOGS_TS] = "";
+    const char *msg = line, *end = line + len;
+
+    if (len && end[-1] == '\r')
+        end--;
+    /* "[12:34:56]" (SA-MP) or "[2024-01-01T12:34:56+0000]" (open.mp) */
+    if (msg < end && *msg == '[') {
+        const char *close = memchr(msg, ']', (size_t)(end - msg));
+        if (close && close - msg < LOGS_TS && close - msg > 1 &&
+            (msg[1] >= '0' && msg[1] <= '9')) {
+            snprintf(ts, sizeof(ts), "%.*s", (int)(close - msg + 1), msg);
+            msg = close + 1;
+            while (msg < end && *msg == ' ') msg++;
+        }
+    }
+    size_t mlen = (size_t)(end - msg);
+
+    if (c->live) {
+        int bad = memmem(msg, mlen, "Run time error", 14) || memmem(msg, mlen, "crashed", 7);
+        printf("%s%.*s%s\n", bad ? COL_RED : COL_YELLOW, (int)len, line, COL_DEFAULT);
+    }
+
+    if (mlen > 8 && memcmp(msg, "[debug] ", 8) == 0) {
+        msg += 8;
+        mlen -= 8;
+        if (mlen > 14 && memcmp(msg, "Run time error", 14) == 0) {
+            logs_event_open(c, 'E', ts, msg, mlen);
+            c->event_line = line;
+        } else if (mlen > 14 && memcmp(msg, "Server crashed", 14) == 0) {
+            logs_event_open(c, 'C', ts, msg, mlen);
+            c->event_line = line;
+        } else if (mlen > 1 && msg[0] == '#' && c->open)
+            logs_frame(c, msg, mlen);
+        return;
+    }
+
+    logs_event_close(c);
+
+    char sig[LOGS_SIG];
+    if (memmem(msg, mlen, "Run time error", 14)) {
+        snprintf(sig, sizeof(sig), "%.*s", (int)(mlen < 200 ? mlen : 200), msg);
+        for (char *p = sig; *p; p++)
+            if (*p == '\t') *p = ' ';
+        logs_hit(c, 'E', sig, ts);
+    } else if (memmem(msg, mlen, "Warning", 7)) {
+        logs_warning_sig(sig, msg, mlen < 200 ? mlen : 200);
+        logs_hit(c, 'W', sig, ts);
+    }
+}
+
+static int logs_needle(const char *p, size_t left) {
+    for (int k = 0; k < 3; k++) {
+        size_t n = strlen(logs_needles[k]);
+        if (n <= left && memcmp(p, logs_needles[k], n) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* Scan buf, hand flagged lines to logs_line; returns the bytes consumed (complete lines) */
+static size_t logs_scan(struct logs_ctx *c, const char *buf, size_t len) {
+    const unsigned char *u = (const unsigned char *)buf;
+    size_t start = 0, i = 0;
+    int flagged = 0;
+
+    for (; i + 33 <= len; i += 32) {
+        uint32_t nl, kw;
+        c->block(u + i, &nl, &kw);
+        if ((nl | kw) == 0)
+            continue;
+        c->lines += (unsigned)__builtin_popcount(nl);
+        for (uint32_t all = nl | kw; all; all &= all - 1) {
+            int b = __builtin_ctz(all);
+            size_t pos = i + (size_t)b;
+            if ((kw >> b) & 1) {
+                if (!flagged)
+                    flagged = logs_needle(buf + pos, len - pos);
+                continue;
+            }
+            if (flagged)
+                logs_line(c, buf + start, pos - start);
+            start = pos + 1;
+            flagged = 0;
+        }
+    }
+    for (; i < len; i++) {
+        if (buf[i] == '\n') {
+            c->lines++;
+            if (flagged)
+                logs_line(c, buf + start, i - start);
+            start = i + 1;
+            flagged = 0;
+        } else if (!flagged && i + 1 < len) {
+            flagged = logs_needle(buf + i, len - i);
+        }
+    }
+    c->bytes += start;
+    return start;
+}
+
+/* ---- state ---- */
+
+static void logs_load(struct logs_ctx *c) {
+    char line[LOGS_SIG + 256];
+    FILE *fp = fopen(KOM_LOGS_STATE, "r");
+
+    if (fp == NULL)
+        return;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strncmp(line, "file ", 5) == 0 && c->nfiles < LOGS_FILES) {
+            struct logs_file *f = &c->files[c->nfiles];
+            unsigned long long dev, ino;
+            long long off;
+            int at = 0;
+            if (sscanf(line, "file %llu %llu %lld %n", &dev, &ino, &off, &at) == 3 && at > 0) {
+                f->dev = (dev_t)dev;
+                f->ino = (ino_t)ino;
+                f->offset = (off_t)off;
+                snprintf(f->path, sizeof(f->path), "%s", line + at);
+                c->nfiles++;
+            }
+        } else if (strncmp(line, "group ", 6) == 0) {
+            char kind;
+            long count;
+            int at = 0;
+            if (sscanf(line, "group %c %ld %n", &kind, &count, &at) != 2 || at == 0)
+                continue;
+            char *first = line + at, *last = strchr(first, '\t');
+            char *sig = last ? strchr(last + 1, '\t') : NULL;
+            if (sig == NULL)
+                continue;
+            *last++ = '\0';
+            *sig++ = '\0';
+            struct logs_group *g = logs_group(c, kind, sig);
+            if (g) {
+                g->count = count;
+                snprintf(g->first, sizeof(g->first), "%s", first);
+                snprintf(g->last, sizeof(g->last), "%s", last);
+            }
+        }
+    }
+    fclose(fp);
+}
+
+static void logs_save(struct logs_ctx *c) {
+    FILE *fp;
+
+    kom_mkdir_p(".komodo");
+    if ((fp = fopen(KOM_LOGS_STATE ".tmp", "w")) == NULL)
+        return;
+    for (int i = 0; i < c->nfiles; i++) {
+        fprintf(fp, "file %llu %llu %lld %s\n", (unsigned long long)c->files[i].dev,
+                (unsigned long long)c->files[i].ino, (long long)c->files[i].offset, c->files[i].path);
+    }
+    for (size_t i = 0; i < c->ngroups; i++) {
+        struct logs_group *g = &c->groups[i];
+        fprintf(fp, "group %c %ld %s\t%s\t%s\n", g->kind, g->count, g->first, g->last, g->sig);
+    }
+    fclose(fp);
+    rename(KOM_LOGS_STATE ".tmp", KOM_LOGS_STATE);
+}
+
+static struct logs_file *logs_file(struct logs_ctx *c, const char *path) {
+    for (int i = 0; i < c->nfiles; i++) {
+        if (strcmp(c->files[i].path, path) == 0)
+            return &c->files[i];
+    }
+    if (c->nfiles == LOGS_FILES)
+        return NULL;
+    struct logs_file *f = &c->files[c->nfiles++];
+    memset(f, 0, sizeof(*f));
+    snprintf(f->path, sizeof(f->path), "%s", path);
+    return f;
+}
+
+/* Nothing written to the file for LOGS_IDLE_MS */
+static int logs_quiet(const struct stat *st) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (now.tv_sec - st->st_mtim.tv_sec) * 1000 +
+           (now.tv_nsec - st->st_mtim.tv_nsec) / 1000000 >= LOGS_IDLE_MS;
+}
+
+/*
+ * Map and scan whatever was appended to f since its checkpoint. Outside
+ * follow mode a backtrace still open at the end of a file that is being
+ * written to is not counted: the checkpoint stops at its first line, so
+ * the next run reads it again once crashdetect has finished it.
+ */
+static int logs_read(struct logs_ctx *c, struct logs_file *f) {
+    struct stat st;
+    int fd = open(f->path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    /* rotated or truncated: start over */
+    if (st.st_dev != f->dev || st.st_ino != f->ino || st.st_size < f->offset) {
+        f->dev = st.st_dev;
+        f->ino = st.st_ino;
+        f->offset = 0;
+    }
+    if (st.st_size == f->offset) {
+        close(fd);
+        return 0;
+    }
+
+    long page = sysconf(_SC_PAGESIZE);
+    off_t base = f->offset & ~((off_t)page - 1);
+    size_t maplen = (size_t)(st.st_size - base);
+    char *map = mmap(NULL, maplen, PROT_READ, MAP_PRIVATE, fd, base);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    madvise(map, maplen, MADV_SEQUENTIAL);
+
+    size_t skip = (size_t)(f->offset - base);
+    size_t used = logs_scan(c, map + skip, maplen - skip);
+    if (c->open && !c->live) {
+        if (logs_quiet(&st))
+            logs_event_close(c);
+        else if (c->event_line != NULL) {
+            used = (size_t)(c->event_line - (map + skip));
+            c->open = 0;
+        }
+    }
+    c->event_line = NULL;
+    f->offset += (off_t)used;
+    munmap(map, maplen);
+    return 0;
+}
+
+/* ---- report ---- */
+
+static int logs_cmp(const void *a, const void *b) {
+    const struct logs_group *x = a, *y = b;
+    if ((x->kind == 'W') != (y->kind == 'W'))
+        return x->kind == 'W' ? 1 : -1;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+static void logs_report(struct logs_ctx *c) {
+    size_t shown = 0, crashes = 0, warnings = 0;
+    struct logs_group *sorted = malloc(c->ngroups * sizeof(*sorted));
+
+    if (sorted == NULL)
+        return;
+    memcpy(sorted, c->groups, c->ngroups * sizeof(*sorted));
+    qsort(sorted, c->ngroups, sizeof(*sorted), logs_cmp);
+
+    for (size_t i = 0; i < c->ngroups; i++) {
+        struct logs_group *g = &sorted[i];
+        if (g->kind == 'W') {
+            warnings += (size_t)g->count;
+            continue;
+        }
+        crashes += (size_t)g->count;
+        if (shown++ == LOGS_TOP)
+            continue;
+        printf("%s%6ldx%s %s%s  first %s  last %s\n        %s\n",
+               g->fresh ? COL_RED : "", g->count, g->fresh ? COL_DEFAULT : "",
+               g->kind == 'C' ? "crash" : "error",
+               g->fresh ? " (new hits)" : "", g->first, g->last, g->sig);
+    }
+    for (size_t i = 0, w = 0; i < c->ngroups && w < 5; i++) {
+        if (sorted[i].kind == 'W' && sorted[i].fresh) {
+            printf_color(COL_YELLOW, "%6ldx warning  %s", sorted[i].count, sorted[i].sig);
+            w++;
+        }
+    }
+    if (shown > LOGS_TOP)
+        println("... %zu more signatures in " KOM_LOGS_STATE, shown - LOGS_TOP);
+    println("logs: %zu errors/crashes in %zu signatures, %zu warnings", crashes, shown, warnings);
+    free(sorted);
+}
+
+/* ---- follow ---- */
+
+static void logs_follow(struct logs_ctx *c, char paths[][PATH_MAX], int npaths) {
+    int ino = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    int wds[LOGS_FILES];
+    sigset_t mask, oldmask;
+
+    if (ino < 0) {
+        perror("[err]: inotify");
+        return;
+    }
+    /* watch the directories so rotation (a new inode) is noticed too */
+    for (int i = 0; i < npaths; i++) {
+        char tmp[PATH_MAX];
+        memcpy(tmp, paths[i], sizeof(tmp));     /* dirname() writes into its argument */
+        wds[i] = inotify_add_watch(ino, dirname(tmp), IN_MODIFY | IN_CREATE | IN_MOVED_TO);
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN };
+    ev.data.fd = ino;
+    epoll_ctl(ep, EPOLL_CTL_ADD, ino, &ev);
+    ev.data.fd = sfd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &ev);
+
+    c->live = 1;
+    println("logs: following %d file(s), Ctrl-C to stop", npaths);
+    for (;;) {
+        struct epoll_event events[2];
+        /* a backtrace is complete once the log has been quiet for a moment */
+        int n = epoll_wait(ep, events, 2, c->open ? LOGS_IDLE_MS : -1);
+        if (n < 0 && errno != EINTR)
+            break;
+        if (n == 0) {
+            logs_event_close(c);
+            logs_save(c);
+            continue;
+        }
+
+        int stop = 0, dirty = 0;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == sfd) {
+                stop = 1;
+                continue;
+            }
+            char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t len;
+            while ((len = read(ino, buf, sizeof(buf))) > 0) {
+                for (char *p = buf; p < buf + len;) {
+                    struct inotify_event *ie = (struct inotify_event *)p;
+                    p += sizeof(*ie) + ie->len;
+                    for (int k = 0; k < npaths; k++) {
+                        const char *base = strrchr(paths[k], '/');
+                        base = base ? base + 1 : paths[k];
+                        if (ie->wd == wds[k] && ie->len && strcmp(ie->name, base) == 0)
+                            dirty = 1;
+                    }
+                }
+            }
+        }
+        for (int k = 0; dirty && k < npaths; k++) {
+            struct logs_file *f = logs_file(c, paths[k]);
+            if (f)
+                logs_read(c, f);
+        }
+        if (stop)
+            break;
+    }
+
+    logs_event_close(c);
+    close(ep);
+    close(sfd);
+    close(ino);
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+/*
+ * logs [follow] [reset] [file ...]: without files, server_log.txt and
+ * log.txt of the located server.
+ */
+int call_logs(const char *args) {
+    static char paths[LOGS_FILES][PATH_MAX];
+    struct logs_ctx c;
+    char buf[1024];
+    int npaths = 0, follow = 0;
+
+    memset(&c, 0, sizeof(c));
+    logs_pick_block(&c);
+
+    snprintf(buf, sizeof(buf), "%s", args ? args : "");
+    for (char *tok = strtok(buf, " "); tok; tok = strtok(NULL, " ")) {
+        if (strcmp(tok, "follow") == 0)
+            follow = 1;
+        else if (strcmp(tok, "reset") == 0)
+            unlink(KOM_LOGS_STATE);
+        else if (npaths < LOGS_FILES)
+            snprintf(paths[npaths++], PATH_MAX, "%s", tok);
+    }
+    if (npaths == 0) {
+        const char *names[] = { "server_log.txt", "log.txt" };
+        struct kom_server srv;
+        toml_table_t *conf = kom_toml_load();
+        toml_table_t *serve = conf ? toml_table_in(conf, "serve") : NULL;
+        const char *dir = kom_server_locate(&srv, serve) == 0 ? srv.dir : ".";
+        for (int i = 0; i < 2; i++) {
+            snprintf(paths[npaths], PATH_MAX, "%s/%s", dir, names[i]);
+            if (access(paths[npaths], R_OK) == 0)
+                npaths++;
+        }
+        if (conf)
+            toml_free(conf);
+    }
+    if (npaths == 0) {
+        printf_color(COL_RED, "logs: no server_log.txt or log.txt found");
+        return 1;
+    }
+
+    logs_load(&c);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < npaths; i++) {
+        struct logs_file *f = logs_file(&c, paths[i]);
+        if (f == NULL || logs_read(&c, f) != 0)
+            printf_color(COL_YELLOW, "logs: cannot read %s", paths[i]);
+    }
+    logs_event_close(&c);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    logs_report(&c);
+    println("logs: %.1f MB, %llu lines scanned (%s) in %.0f ms", c.bytes / 1048576.0, c.lines, c.isa, ms);
+
+    if (follow)
+        logs_follow(&c, paths, npaths);
+    logs_save(&c);
+
+    for (size_t i = 0; i < c.ngroups; i++)
+        free(c.groups[i].sig);
+    free(c.groups);
+    free(c.slots);
+    return 0;
+}
@@ -0,0 +1,18 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/logs.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef LOGS_H
+#define LOGS_H
+
+#define KOM_LOGS_STATE  ".komodo/logs.state"
+
+int call_logs(const char *args);
+
+#endif
@@ -18,6 +18,7 @@
 
 #include "utils.h"
 #include "package.h"
+#include "prefetch.h"
 
 typedef struct {
     char key;
@@ -28,25 +29,124 @@ typedef struct {
     const char *windows_file;
 } VersionInfo;
 
+/* Newest first, the head of each list is what prefetch warms up */
+static const char *__pawncc_versions[] = {
+    "3.10.10", "3.10.9", "3.10.8", "3.10.7", "3.10.6",
+    "3.10.5", "3.10.4", "3.10.3", "3.10.2", "3.10.1"
+};
+
+static VersionInfo __samp_versions[] = {
+    { 'A', "SA-MP 0.3.DL R1", 
+        "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp03DLsvr_R1.tar.gz",
+        "samp03DLsvr_R1.tar.gz",
+        "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp03DL_svr_R1_win32.zip",
+        "samp03DL_svr_R1_win32.zip"
+    },
+    { 'B', "SA-MP 0.3.7 R3", 
+        "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037svr_R3.tar.gz",
+        "samp037svr_R3.tar.gz",
+        "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037_svr_R3_win32.zip",
+        "samp037_svr_R3_win32.zip"
+    },
+    { 'C', "SA-MP 0.3.7 R2-2-1", 
+        "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037svr_R2-2-1.tar.gz",
+        "samp037svr_R2-2-1.tar.gz",
+        "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037_svr_R2-1-1_win32.zip",
+        "samp037_svr_R2-2-1_win32.zip"
+    },
+    { 'D', "SA-MP 0.3.7 R2-1-1", 
+        "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037svr_R2-1.tar.gz",
+        "samp037svr_R2-1.tar.gz",
+        "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037_svr_R2-1-1_win32.zip",
+        "samp037_svr_R2-1-1_win32.zip"
+    },
+    { 'E', "OpenMP v1.4.0.2779", 
+        "https://github.com/openmultiplayer/open.mp/releases/download/v1.4.0.2779/open.mp-linux-x86.tar.gz",
+        "open.mp-linux-x86.tar.gz",
+        "https://github.com/openmultiplayer/open.mp/releases/download/v1.4.0.2779/open.mp-win-x86.zip",
+        "open.mp-win-x86.zip"
+    },
+    { 'F', "OpenMP v1.3.1.2748", 
+        "https://github.com/openmultiplayer/open.mp/releases/download/v1.3.1.2748/open.mp-linux-x86.tar.gz",
+        "open.mp-linux-x86.tar.gz",
+        "https://github.com/openmultiplayer/open.mp/releases/download/v1.3.1.2748/open.mp-win-x86.zip",
+        "open.mp-win-x86.zip"
+    },
+    { 'G', "OpenMP v1.2.0.2670", 
+        "https://github.com/openmultiplayer/open.mp/releases/download/v1.2.0.2670/open.mp-linux-x86.tar.gz",
+        "open.mp-linux-x86.tar.gz",
+        "https://github.com/openmultiplayer/open.mp/releases/download/v1.2.0.2670/open.mp-win-x86.zip",
+        "open.mp-win-x86.zip"
+    },
+    { 'H', "OpenMP v1.1.0.2612", 
+        "https://github.com/openmultiplayer/open.mp/releases/download/v1.1.0.2612/open.mp-linux-x86.tar.gz",
+        "open.mp-linux-x86.tar.gz",
+        "https://github.com/openmultiplayer/open.mp/releases/download/v1.1.0.2612/open.mp-win-x86.zip",
+        "open.mp-win-x86.zip"
+    }
+};
+
+#define PAWNCC_VERSIONS (int)(sizeof(__pawncc_versions)/sizeof(__pawncc_versions[0]))
+#define SAMP_VERSIONS   (int)(sizeof(__samp_versions)/sizeof(__samp_versions[0]))
+
+static void pawncc_url(int index, const char *platform,
+                       char *url, size_t url_len, char *fname, size_t fname_len)
+{
+    const char *ext = strcmp(platform, "linux") == 0 ? "tar.gz" : "zip";
+
+    snprintf(url, url_len, "https://github.com/pawn-lang/compiler/releases/download/v%s/pawnc-%s-%s.%s",
+             __pawncc_versions[index], __pawncc_versions[index], platform, ext);
+    if (fname)
+        snprintf(fname, fname_len, "pawnc-%s-%s.%s", __pawncc_versions[index], platform, ext);
+}
+
+/*
+ * Fill urls with the archives a download of kind ("pawncc" or "samp") is
+ * most likely to request on platform, one per distinct host family.
+ */
+int kom_package_likely_urls(const char *kind, const char *platform,
+                            char urls[][KOM_URL_MAX], int max)
+{
+    int n = 0;
+
+    if (strcmp(kind, "pawncc") == 0) {
+        if (n < max)
+            pawncc_url(0, platform, urls[n++], KOM_URL_MAX, NULL, 0);
+    } else if (strcmp(kind, "samp") == 0) {
+        /* newest SA-MP build and newest open.mp release live on different hosts */
+        const char *last_host = NULL;
+        for (int i = 0; i < SAMP_VERSIONS && n < max; i++) {
+            const char *u = strcmp(platform, "linux") == 0 ?
+                __samp_versions[i].linux_url : __samp_versions[i].windows_url;
+            const char *host = strstr(u, "/releases/") ? "releases" : "raw";
+            if (last_host && strcmp(last_host, host) == 0)
+                continue;
+            snprintf(urls[n++], KOM_URL_MAX, "%s", u);
+            last_host = host;
+        }
+    }
+
+    return n;
+}
+
 void call_download_pawncc(const char *platform) {
     char selection, version_selection;
     char url[256], fname[256];
 
-    const char *versions[] = {
-        "3.10.10", "3.10.9", "3.10.8", "3.10.7", "3.10.6",
-        "3.10.5", "3.10.4", "3.10.3", "3.10.2", "3.10.1"
-    };
+    /* warm connections for this platform while the prompts wait on the user */
+    kom_prefetch_start("pawncc", platform);
 
     printf(":: Do you want to continue downloading PawnCC? (Yy/Nn)\n>> ");
     scanf(" %c", &selection);
     if (selection != 'Y' && selection != 'y') {
+        kom_prefetch_cancel();
         void _komodo_();
         return;
     }
 
     printf("Select the PawnCC version to download:\n");
-    for (int i = 0; i < 10; i++) {
-        printf("[%c/%c] PawnCC %s\n", 'A'+i, 'a'+i, versions[i]);
+    for (int i = 0; i < PAWNCC_VERSIONS; i++) {
+        printf("[%c/%c] PawnCC %s\n", 'A'+i, 'a'+i, __pawncc_versions[i]);
     }
 
     printf(">> ");
@@ -54,83 +154,34 @@ void call_download_pawncc(const char *platform) {
     int index = (version_selection >= 'A' && version_selection <= 'J') ? version_selection - 'A'
                : (version_selection >= 'a' && version_selection <= 'j') ? version_selection - 'a' : -1;
 
-    if (index < 0 || index >= 10) {
+    if (index < 0 || index >= PAWNCC_VERSIONS) {
         printf("Invalid selection.\n");
+        kom_prefetch_cancel();
         return;
     }
 
-    const char *ext = strcmp(platform, "linux") == 0 ? "tar.gz" : "zip";
-
-    sprintf(url, "https://github.com/pawn-lang/compiler/releases/download/v%s/pawnc-%s-%s.%s",
-            versions[index], versions[index], platform, ext);
-    sprintf(fname, "pawnc-%s-%s.%s", versions[index], platform, ext);
+    pawncc_url(index, platform, url, sizeof(url), fname, sizeof(fname));
 
     call_download_file(url, fname);
 }
 
 void call_download_samp(const char *platform) {
     char sel_c;
+
+    /* warm connections for this platform while the prompts wait on the user */
+    kom_prefetch_start("samp", platform);
+
     printf(":: Do you want to continue downloading SA-MP? (Yy/Nn): ");
     scanf(" %c", &sel_c);
     if (sel_c != 'Y' && sel_c != 'y') {
+        kom_prefetch_cancel();
         void _komodo_();
         return;
     }
 
-    VersionInfo versions[] = {
-        { 'A', "SA-MP 0.3.DL R1", 
-            "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp03DLsvr_R1.tar.gz",
-            "samp03DLsvr_R1.tar.gz",
-            "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp03DL_svr_R1_win32.zip",
-            "samp03DL_svr_R1_win32.zip"
-        },
-        { 'B', "SA-MP 0.3.7 R3", 
-            "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037svr_R3.tar.gz",
-            "samp037svr_R3.tar.gz",
-            "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037_svr_R3_win32.zip",
-            "samp037_svr_R3_win32.zip"
-        },
-        { 'C', "SA-MP 0.3.7 R2-2-1", 
-            "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037svr_R2-2-1.tar.gz",
-            "samp037svr_R2-2-1.tar.gz",
-            "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037_svr_R2-1-1_win32.zip",
-            "samp037_svr_R2-2-1_win32.zip"
-        },
-        { 'D', "SA-MP 0.3.7 R2-1-1", 
-            "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037svr_R2-1.tar.gz",
-            "samp037svr_R2-1.tar.gz",
-            "https://github.com/vilksons/files.sa-mp.com-Archive/raw/refs/heads/master/samp037_svr_R2-1-1_win32.zip",
-            "samp037_svr_R2-1-1_win32.zip"
-        },
-        { 'E', "OpenMP v1.4.0.2779", 
-            "https://github.com/openmultiplayer/open.mp/releases/download/v1.4.0.2779/open.mp-linux-x86.tar.gz",
-            "open.mp-linux-x86.tar.gz",
-            "https://github.com/openmultiplayer/open.mp/releases/download/v1.4.0.2779/open.mp-win-x86.zip",
-            "open.mp-win-x86.zip"
-        },
-        { 'F', "OpenMP v1.3.1.2748", 
-            "https://github.com/openmultiplayer/open.mp/releases/download/v1.3.1.2748/open.mp-linux-x86.tar.gz",
-            "open.mp-linux-x86.tar.gz",
-            "https://github.com/openmultiplayer/open.mp/releases/download/v1.3.1.2748/open.mp-win-x86.zip",
-            "open.mp-win-x86.zip"
-        },
-        { 'G', "OpenMP v1.2.0.2670", 
-            "https://github.com/openmultiplayer/open.mp/releases/download/v1.2.0.2670/open.mp-linux-x86.tar.gz",
-            "open.mp-linux-x86.tar.gz",
-            "https://github.com/openmultiplayer/open.mp/releases/download/v1.2.0.2670/open.mp-win-x86.zip",
-            "open.mp-win-x86.zip"
-        },
-        { 'H', "OpenMP v1.1.0.2612", 
-            "https://github.com/openmultiplayer/open.mp/releases/download/v1.1.0.2612/open.mp-linux-x86.tar.gz",
-            "open.mp-linux-x86.tar.gz",
-            "https://github.com/openmultiplayer/open.mp/releases/download/v1.1.0.2612/open.mp-win-x86.zip",
-            "open.mp-win-x86.zip"
-        }
-    };
-
     printf("Select the SA-MP version to download:\n");
-    for (int i = 0; i < sizeof(versions)/sizeof(versions[0]); i++) {
-        printf("[%c/%c] %s\n", versions[i].key, versions[i].key + 32, versions[i].name);
+    for (int i = 0; i < SAMP_VERSIONS; i++) {
+        printf("[%c/%c] %s\n", __samp_versions[i].key, __samp_versions[i].key + 32, __samp_versions[i].name);
     }
 
     printf(">> ");
@@ -138,15 +189,16 @@ void call_download_samp(const char *platform) {
     scanf(" %c", &version_choice);
 
     VersionInfo *chosen = NULL;
-    for (int i = 0; i < sizeof(versions)/sizeof(versions[0]); i++) {
-        if (version_choice == versions[i].key || version_choice == versions[i].key + 32) {
-            chosen = &versions[i];
+    for (int i = 0; i < SAMP_VERSIONS; i++) {
+        if (version_choice == __samp_versions[i].key || version_choice == __samp_versions[i].key + 32) {
+            chosen = &__samp_versions[i];
             break;
         }
     }
 
     if (!chosen) {
         printf("Invalid selection\n");
+        kom_prefetch_cancel();
         void _komodo_();
         return;
     }
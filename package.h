@@ -11,6 +11,10 @@
 #ifndef PACKAGE_H
 #define PACKAGE_H
 
+#define KOM_URL_MAX 512
+
+int kom_package_likely_urls(const char *kind, const char *platform,
+                            char urls[][KOM_URL_MAX], int max);
 void call_download_pawncc(const char *platform);
 void call_download_samp(const char *platform);
 
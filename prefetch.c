@@ -0,0 +1,255 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/prefetch.c
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <curl/curl.h>
+
+#include "utils.h"
+#include "package.h"
+#include "prefetch.h"
+
+/*
+ * Speculative warm-up for the download commands. While komodo waits on
+ * the platform/confirm/version prompts, a background thread HEADs the most
+ * likely archives through the shared curl handle: DNS, TCP and TLS to
+ * github.com and its redirect targets end up in the shared connection
+ * pool, and the archive sizes are known before the real transfer starts.
+ */
+
+#define PREFETCH_MAX      4
+#define PREFETCH_TTL      60      /* seconds a finished prefetch stays valid */
+#define PREFETCH_WAIT_MS  1500    /* how long a download waits on a prefetch */
+
+struct prefetch_entry {
+    char url[KOM_URL_MAX];
+    curl_off_t length;
+    int ok;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t tid;
+    int active;             /* thread started and not yet joined */
+    int finished;           /* every request completed or failed */
+    _Atomic int cancel;
+    CURLM *multi;           /* published while the thread polls, for wakeup */
+    char kind[16];
+    char platform[16];
+    time_t stamp;
+    int count;
+    struct prefetch_entry entry[PREFETCH_MAX];
+} __pf = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+static int prefetch_abort(void *ptr,
+                          curl_off_t dltotal, curl_off_t dlnow,
+                          curl_off_t ultotal, curl_off_t ulnow)
+{
+    (void)ptr;
+    (void)dltotal;
+    (void)dlnow;
+    (void)ultotal;
+    (void)ulnow;
+    /* non-zero aborts the transfer, so a cancel tears down handshakes too */
+    return atomic_load_explicit(&__pf.cancel, memory_order_relaxed);
+}
+
+static void *prefetch_run(void *arg) {
+    (void)arg;
+    CURLM *multi = curl_multi_init();
+    CURL *easy[PREFETCH_MAX] = { 0 };
+    int running = 0;
+
+    if (multi == NULL)
+        goto finish;
+
+    for (int i = 0; i < __pf.count; i++) {
+        easy[i] = curl_easy_init();
+        if (easy[i] == NULL)
+            continue;
+        curl_easy_setopt(easy[i], CURLOPT_URL, __pf.entry[i].url);
+        curl_easy_setopt(easy[i], CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(easy[i], CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy[i], CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(easy[i], CURLOPT_SHARE, kom_curl_share());
+        curl_easy_setopt(easy[i], CURLOPT_XFERINFOFUNCTION, prefetch_abort);
+        curl_easy_setopt(easy[i], CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(easy[i], CURLOPT_PRIVATE, (void *)&__pf.entry[i]);
+        curl_multi_add_handle(multi, easy[i]);
+    }
+
+    pthread_mutex_lock(&__pf.lock);
+    __pf.multi = multi;
+    pthread_mutex_unlock(&__pf.lock);
+
+    do {
+        curl_multi_perform(multi, &running);
+        if (running && !atomic_load(&__pf.cancel))
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+    } while (running && !atomic_load(&__pf.cancel));
+
+    /* Collect what finished: final response code and content length */
+    CURLMsg *msg;
+    int left;
+    while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+        if (msg->msg != CURLMSG_DONE || msg->data.result != CURLE_OK)
+            continue;
+
+        struct prefetch_entry *e = NULL;
+        long code = 0;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&e);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+        if (e && code >= 200 && code < 300) {
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &e->length);
+            e->ok = 1;
+        }
+    }
+
+    pthread_mutex_lock(&__pf.lock);
+    __pf.multi = NULL;
+    pthread_mutex_unlock(&__pf.lock);
+
+    for (int i = 0; i < __pf.count; i++) {
+        if (easy[i]) {
+            curl_multi_remove_handle(multi, easy[i]);
+            curl_easy_cleanup(easy[i]);
+        }
+    }
+    curl_multi_cleanup(multi);
+
+finish:
+    pthread_mutex_lock(&__pf.lock);
+    __pf.finished = 1;
+    pthread_cond_broadcast(&__pf.cond);
+    pthread_mutex_unlock(&__pf.lock);
+    return NULL;
+}
+
+/*
+ * Stop a running prefetch and forget its results. Wakes the poll loop so
+ * this returns as soon as libcurl has dropped the in-flight handshakes.
+ */
+void kom_prefetch_cancel(void) {
+    pthread_mutex_lock(&__pf.lock);
+    if (!__pf.active) {
+        pthread_mutex_unlock(&__pf.lock);
+        return;
+    }
+    atomic_store(&__pf.cancel, 1);
+    if (__pf.multi)
+        curl_multi_wakeup(__pf.multi);
+    pthread_mutex_unlock(&__pf.lock);
+
+    pthread_join(__pf.tid, NULL);
+
+    pthread_mutex_lock(&__pf.lock);
+    __pf.active = 0;
+    __pf.count = 0;
+    pthread_mutex_unlock(&__pf.lock);
+}
+
+/*
+ * Start warming up for a "pawncc" or "samp" download on platform. A
+ * prefetch already running (or fresh) for the same target is kept.
+ */
+void kom_prefetch_start(const char *kind, const char *platform) {
+    if (platform == NULL ||
+        (strcmp(platform, "linux") != 0 && strcmp(platform, "windows") != 0))
+        return;
+
+    pthread_mutex_lock(&__pf.lock);
+    int same = __pf.active &&
+               strcmp(__pf.kind, kind) == 0 &&
+               strcmp(__pf.platform, platform) == 0 &&
+               time(NULL) - __pf.stamp < PREFETCH_TTL;
+    pthread_mutex_unlock(&__pf.lock);
+    if (same)
+        return;
+
+    kom_prefetch_cancel();
+
+    char urls[PREFETCH_MAX][KOM_URL_MAX];
+    int n = kom_package_likely_urls(kind, platform, urls, PREFETCH_MAX);
+    if (n <= 0)
+        return;
+
+    pthread_mutex_lock(&__pf.lock);
+    snprintf(__pf.kind, sizeof(__pf.kind), "%s", kind);
+    snprintf(__pf.platform, sizeof(__pf.platform), "%s", platform);
+    memset(__pf.entry, 0, sizeof(__pf.entry));
+    for (int i = 0; i < n; i++)
+        memcpy(__pf.entry[i].url, urls[i], KOM_URL_MAX);
+    __pf.count = n;
+    __pf.finished = 0;
+    __pf.stamp = time(NULL);
+    atomic_store(&__pf.cancel, 0);
+
+    if (pthread_create(&__pf.tid, NULL, prefetch_run, NULL) == 0)
+        __pf.active = 1;
+    else
+        __pf.count = 0;
+    pthread_mutex_unlock(&__pf.lock);
+}
+
+/*
+ * Look up the prefetched size of url. Waits briefly when url is one of
+ * the requests still in flight; any other url returns at once. Past that the download simply proceeds on whatever
+ * connections are already warm.
+ */
+int kom_prefetch_lookup(const char *url, curl_off_t *length) {
+    struct timespec deadline;
+    int ret = 0, timed_out = 0, slot = -1;
+
+    pthread_mutex_lock(&__pf.lock);
+    if (__pf.active) {
+        for (int i = 0; i < __pf.count; i++) {
+            if (strcmp(__pf.entry[i].url, url) == 0) {
+                slot = i;
+                break;
+            }
+        }
+    }
+    if (slot < 0) {
+        pthread_mutex_unlock(&__pf.lock);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += PREFETCH_WAIT_MS / 1000;
+    deadline.tv_nsec += (PREFETCH_WAIT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (!__pf.finished) {
+        if (pthread_cond_timedwait(&__pf.cond, &__pf.lock, &deadline) == ETIMEDOUT) {
+            timed_out = !__pf.finished;
+            break;
+        }
+    }
+
+    if (!timed_out && __pf.entry[slot].ok) {
+        *length = __pf.entry[slot].length;
+        ret = 1;
+    }
+    pthread_mutex_unlock(&__pf.lock);
+
+    if (timed_out)
+        kom_prefetch_cancel();
+
+    return ret;
+}
@@ -0,0 +1,20 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/prefetch.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <curl/curl.h>
+
+void kom_prefetch_start(const char *kind, const char *platform);
+void kom_prefetch_cancel(void);
+int kom_prefetch_lookup(const char *url, curl_off_t *length);
+
+#endif
@@ -0,0 +1,440 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/progress.c
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#include <ncurses.h>
+#include <term.h>
+
+#include "progress.h"
+
+/*
+ * Transfers and extractors only ever touch their own slot with relaxed
+ * atomic stores, so a libcurl progress tick costs two stores instead of
+ * a printf + fflush. A single detached renderer thread owns the terminal
+ * and redraws all live slots at KOM_PROGRESS_HZ; it exits on its own once
+ * every slot has been drawn in its final state. Lines other code prints
+ * meanwhile go through kom_progress_printf, which hands them to the
+ * renderer to print above the live region instead of under the redraw.
+ */
+
+enum {
+    SLOT_FREE = 0,      /* unused */
+    SLOT_CLAIMED,       /* being initialised by kom_progress_add */
+    SLOT_ACTIVE,        /* counters are live */
+    SLOT_DONE           /* finished, waiting for its final line */
+};
+
+struct kom_task {
+    _Atomic int state;
+    _Atomic int64_t now;
+    _Atomic int64_t total;
+    int64_t started;        /* ns, written before the slot is published */
+    char label[40];
+};
+
+static struct kom_task __tasks[KOM_PROGRESS_SLOTS];
+
+static pthread_mutex_t __render_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __render_idle = PTHREAD_COND_INITIALIZER;
+static int __render_running;
+
+/* Renderer-private state, never touched by the producers */
+static struct {
+    int64_t last_now;
+    int64_t last_ns;
+    double rate;            /* bytes per second, smoothed */
+} __rates[KOM_PROGRESS_SLOTS];
+
+/* Lines queued by kom_progress_printf, guarded by __render_lock */
+static char __messages[8192];
+static size_t __messages_len;
+
+static char __frame[16384];
+static size_t __frame_len;
+static int __drawn;         /* live lines currently on screen */
+
+static int64_t kom_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int frame_putc(int c) {
+    if (__frame_len < sizeof(__frame))
+        __frame[__frame_len++] = (char)c;
+    return c;
+}
+
+static void frame_printf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(__frame + __frame_len, sizeof(__frame) - __frame_len, fmt, args);
+    va_end(args);
+    if (n > 0) {
+        __frame_len += (size_t)n;
+        if (__frame_len > sizeof(__frame))
+            __frame_len = sizeof(__frame);
+    }
+}
+
+static void frame_cap(const char *cap) {
+    if (cap && cap != (char *)-1)
+        tputs(cap, 1, frame_putc);
+}
+
+static void frame_flush(void) {
+    size_t off = 0;
+    fflush(stdout);
+    while (off < __frame_len) {
+        ssize_t n = write(STDOUT_FILENO, __frame + off, __frame_len - off);
+        if (n <= 0)
+            break;
+        off += (size_t)n;
+    }
+    __frame_len = 0;
+}
+
+static const char *fmt_size(char *buf, size_t len, double bytes) {
+    const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    int u = 0;
+    while (bytes >= 1024.0 && u < 4) {
+        bytes /= 1024.0;
+        u++;
+    }
+    snprintf(buf, len, u ? "%.1f %s" : "%.0f %s", bytes, units[u]);
+    return buf;
+}
+
+static const char *fmt_eta(char *buf, size_t len, double secs) {
+    if (secs < 0 || secs > 359999) {
+        snprintf(buf, len, "--:--");
+    } else if (secs >= 3600) {
+        snprintf(buf, len, "%d:%02d:%02d",
+                 (int)secs / 3600, ((int)secs / 60) % 60, (int)secs % 60);
+    } else {
+        snprintf(buf, len, "%02d:%02d", (int)secs / 60, (int)secs % 60);
+    }
+    return buf;
+}
+
+static int term_width(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+        return ws.ws_col;
+    return 80;
+}
+
+/* Sample a slot and refresh its smoothed rate */
+static void sample_slot(int i, int64_t ts, int64_t *now, int64_t *total) {
+    *now = atomic_load_explicit(&__tasks[i].now, memory_order_relaxed);
+    *total = atomic_load_explicit(&__tasks[i].total, memory_order_relaxed);
+
+    if (__rates[i].last_ns == 0) {
+        __rates[i].last_ns = __tasks[i].started;
+        __rates[i].last_now = 0;
+    }
+
+    int64_t dt = ts - __rates[i].last_ns;
+    if (dt >= 50000000LL) {
+        double inst = (double)(*now - __rates[i].last_now) * 1e9 / (double)dt;
+        __rates[i].rate = __rates[i].rate > 0 ? __rates[i].rate * 0.7 + inst * 0.3 : inst;
+        __rates[i].last_now = *now;
+        __rates[i].last_ns = ts;
+    }
+}
+
+static void draw_line(int i, int state, int64_t ts, int width) {
+    char s_now[24], s_total[24], s_rate[24], s_eta[16];
+    int64_t now, total;
+
+    sample_slot(i, ts, &now, &total);
+
+    if (state == SLOT_DONE) {
+        double secs = (double)(ts - __tasks[i].started) / 1e9;
+        frame_printf("%-24.24s done  %s in %.1fs", __tasks[i].label,
+                     fmt_size(s_now, sizeof(s_now), (double)now), secs);
+        return;
+    }
+
+    double rate = __rates[i].rate;
+    fmt_size(s_rate, sizeof(s_rate), rate);
+
+    if (total <= 0) {
+        frame_printf("%-24.24s %s  %s/s", __tasks[i].label,
+                     fmt_size(s_now, sizeof(s_now), (double)now), s_rate);
+        return;
+    }
+
+    double frac = (double)now / (double)total;
+    if (frac > 1.0) frac = 1.0;
+    fmt_eta(s_eta, sizeof(s_eta), rate > 0 ? (double)(total - now) / rate : -1);
+    fmt_size(s_total, sizeof(s_total), (double)total);
+
+    /* label(24) + brackets/pct(9) + rate/eta(~28) leaves the rest for the bar */
+    int bar = width - 64;
+    if (bar > 40) bar = 40;
+
+    frame_printf("%-24.24s ", __tasks[i].label);
+    if (bar >= 8) {
+        int fill = (int)(frac * bar);
+        frame_putc('[');
+        for (int b = 0; b < bar; b++)
+            frame_putc(b < fill ? '#' : '-');
+        frame_putc(']');
+    }
+    frame_printf(" %3.0f%%  %s  %s/s  ETA %s", frac * 100.0, s_total, s_rate, s_eta);
+}
+
+static void release_slot(int i) {
+    memset(&__rates[i], 0, sizeof(__rates[i]));
+    atomic_store_explicit(&__tasks[i].state, SLOT_FREE, memory_order_release);
+}
+
+/*
+ * TTY frame: move back over the live region, print finished tasks once so
+ * they scroll into history, then redraw the live tasks below them.
+ */
+static void render_tty(int64_t ts) {
+    int width = term_width();
+    int live = 0;
+
+    frame_putc('\r');
+    for (int i = 0; i < __drawn; i++)
+        frame_cap(tigetstr("cuu1"));
+
+    /* queued messages scroll into history first, like finished tasks */
+    pthread_mutex_lock(&__render_lock);
+    for (size_t i = 0; i < __messages_len; i++) {
+        if (__messages[i] == '\n')
+            frame_cap(tigetstr("el"));
+        frame_putc(__messages[i]);
+    }
+    __messages_len = 0;
+    pthread_mutex_unlock(&__render_lock);
+
+    for (int pass = SLOT_DONE; pass >= SLOT_ACTIVE; pass--) {
+        for (int i = 0; i < KOM_PROGRESS_SLOTS; i++) {
+            int state = atomic_load_explicit(&__tasks[i].state, memory_order_acquire);
+            if (state != pass)
+                continue;
+            draw_line(i, state, ts, width);
+            frame_cap(tigetstr("el"));
+            frame_putc('\n');
+            if (state == SLOT_DONE)
+                release_slot(i);
+            else
+                live++;
+        }
+    }
+
+    frame_cap(tigetstr("ed"));
+    __drawn = live;
+    frame_flush();
+}
+
+/* Non-TTY: a summary line every couple of seconds, a line per completion */
+static void render_plain(int64_t ts, int summary) {
+    int live = 0;
+
+    for (int i = 0; i < KOM_PROGRESS_SLOTS; i++) {
+        int state = atomic_load_explicit(&__tasks[i].state, memory_order_acquire);
+        if (state == SLOT_DONE) {
+            draw_line(i, state, ts, 0);
+            frame_putc('\n');
+            release_slot(i);
+        }
+    }
+
+    if (summary) {
+        for (int i = 0; i < KOM_PROGRESS_SLOTS; i++) {
+            int state = atomic_load_explicit(&__tasks[i].state, memory_order_acquire);
+            if (state != SLOT_ACTIVE)
+                continue;
+            char s_now[24];
+            int64_t now, total;
+            sample_slot(i, ts, &now, &total);
+            frame_printf("%s%s ", live++ ? "; " : "progress: ", __tasks[i].label);
+            if (total > 0)
+                frame_printf("%.0f%%", (double)now * 100.0 / (double)total);
+            else
+                frame_printf("%s", fmt_size(s_now, sizeof(s_now), (double)now));
+        }
+        if (live)
+            frame_putc('\n');
+    }
+
+    frame_flush();
+}
+
+static int slots_in_use(void) {
+    for (int i = 0; i < KOM_PROGRESS_SLOTS; i++) {
+        if (atomic_load_explicit(&__tasks[i].state, memory_order_acquire) != SLOT_FREE)
+            return 1;
+    }
+    return 0;
+}
+
+static int progress_is_tty(void) {
+    static int __checked = 0, __tty = 0;
+    if (!__checked) {
+        int err;
+        __checked = 1;
+        if (isatty(STDOUT_FILENO) &&
+            setupterm(NULL, STDOUT_FILENO, &err) == OK) {
+            const char *up = tigetstr("cuu1");
+            __tty = up && up != (char *)-1;
+        }
+    }
+    return __tty;
+}
+
+static void *progress_render(void *arg) {
+    (void)arg;
+    const struct timespec tick = { 0, 1000000000L / KOM_PROGRESS_HZ };
+    int tty = progress_is_tty();
+    int64_t last_summary = kom_now_ns();
+
+    for (;;) {
+        nanosleep(&tick, NULL);
+
+        int64_t ts = kom_now_ns();
+        if (tty) {
+            render_tty(ts);
+        } else {
+            int summary = ts - last_summary >= 2000000000LL;
+            if (summary)
+                last_summary = ts;
+            render_plain(ts, summary);
+        }
+
+        if (!slots_in_use()) {
+            pthread_mutex_lock(&__render_lock);
+            if (!slots_in_use() && __messages_len == 0) {
+                __render_running = 0;
+                pthread_cond_broadcast(&__render_idle);
+                pthread_mutex_unlock(&__render_lock);
+                return NULL;
+            }
+            pthread_mutex_unlock(&__render_lock);
+        }
+    }
+}
+
+static int progress_start_renderer(void) {
+    int ret = 0;
+
+    pthread_mutex_lock(&__render_lock);
+    if (!__render_running) {
+        pthread_t tid;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&tid, &attr, progress_render, NULL) == 0)
+            __render_running = 1;
+        else
+            ret = -1;
+        pthread_attr_destroy(&attr);
+    }
+    pthread_mutex_unlock(&__render_lock);
+
+    return ret;
+}
+
+/*
+ * Register a task and return its slot id, or -1 when every slot is taken.
+ * A total of 0 means "unknown"; it can be filled in later by update.
+ */
+int kom_progress_add(const char *label, int64_t total) {
+    for (int i = 0; i < KOM_PROGRESS_SLOTS; i++) {
+        int expect = SLOT_FREE;
+        if (!atomic_compare_exchange_strong(&__tasks[i].state, &expect, SLOT_CLAIMED))
+            continue;
+
+        struct kom_task *t = &__tasks[i];
+        snprintf(t->label, sizeof(t->label), "%s", label ? label : "task");
+        atomic_store_explicit(&t->now, 0, memory_order_relaxed);
+        atomic_store_explicit(&t->total, total, memory_order_relaxed);
+        t->started = kom_now_ns();
+        atomic_store_explicit(&t->state, SLOT_ACTIVE, memory_order_release);
+
+        if (progress_start_renderer() != 0) {
+            atomic_store_explicit(&t->state, SLOT_FREE, memory_order_release);
+            return -1;
+        }
+        return i;
+    }
+    return -1;
+}
+
+void kom_progress_update(int id, int64_t now, int64_t total) {
+    if (id < 0 || id >= KOM_PROGRESS_SLOTS)
+        return;
+    if (total > 0)
+        atomic_store_explicit(&__tasks[id].total, total, memory_order_relaxed);
+    atomic_store_explicit(&__tasks[id].now, now, memory_order_relaxed);
+}
+
+void kom_progress_advance(int id, int64_t delta) {
+    if (id < 0 || id >= KOM_PROGRESS_SLOTS)
+        return;
+    atomic_fetch_add_explicit(&__tasks[id].now, delta, memory_order_relaxed);
+}
+
+void kom_progress_done(int id) {
+    if (id < 0 || id >= KOM_PROGRESS_SLOTS)
+        return;
+    atomic_store_explicit(&__tasks[id].state, SLOT_DONE, memory_order_release);
+}
+
+/*
+ * Print a line (fmt ends in '\n') without it being overwritten by the next
+ * redraw: while the TTY renderer runs it is queued and drawn above the
+ * live tasks, otherwise it goes straight to fp.
+ */
+void kom_progress_printf(FILE *fp, const char *fmt, ...) {
+    va_list args;
+
+    pthread_mutex_lock(&__render_lock);
+    if (__render_running && progress_is_tty()) {
+        va_start(args, fmt);
+        int n = vsnprintf(__messages + __messages_len, sizeof(__messages) - __messages_len, fmt, args);
+        va_end(args);
+        if (n >= 0 && (size_t)n < sizeof(__messages) - __messages_len) {
+            __messages_len += (size_t)n;
+            pthread_mutex_unlock(&__render_lock);
+            return;
+        }
+        __messages[__messages_len] = '\0';    /* queue full: print it directly */
+    }
+    va_start(args, fmt);
+    vfprintf(fp, fmt, args);
+    va_end(args);
+    fflush(fp);
+    pthread_mutex_unlock(&__render_lock);
+}
+
+/*
+ * Block until the renderer has drawn every task in its final state, so
+ * the caller can print to the terminal without racing the redraw.
+ */
+void kom_progress_wait(void) {
+    pthread_mutex_lock(&__render_lock);
+    while (__render_running)
+        pthread_cond_wait(&__render_idle, &__render_lock);
+    pthread_mutex_unlock(&__render_lock);
+}
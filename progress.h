@@ -0,0 +1,27 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/progress.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define KOM_PROGRESS_SLOTS   32   /* max tasks shown at once */
+#define KOM_PROGRESS_HZ      10   /* renderer redraw rate on a TTY */
+
+int kom_progress_add(const char *label, int64_t total);
+void kom_progress_update(int id, int64_t now, int64_t total);
+void kom_progress_advance(int id, int64_t delta);
+void kom_progress_done(int id);
+void kom_progress_wait(void);
+void kom_progress_printf(FILE *fp, const char *fmt, ...);
+
+#endif
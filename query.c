@@ -0,0 +1,514 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/query.c
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+
+#include "color.h"
+#include "utils.h"
+#include "rcon.h"
+#include "query.h"
+
+/*
+ * `query`: poll many servers with the SA-MP query protocol at once.
+ * Every target gets the info ('i'), rules ('r'), clients ('c') and ping
+ * ('p') opcodes from a single unconnected UDP socket; requests go out in
+ * sendmmsg batches, answers come back through recvmmsg and are matched to
+ * every target with that source address by opcode (and cookie for 'p'). A request that is not
+ * answered within the timeout is resent, up to `retries` times.
+ */
+
+#define QUERY_OPS       4
+#define QUERY_BATCH     64
+#define QUERY_RECV_SIZE 8192
+
+static const char query_ops[QUERY_OPS] = { 'i', 'r', 'c', 'p' };
+
+struct query_req {
+    int target;
+    char op;
+    int tries;
+    int done;
+    struct timespec sent;
+    unsigned char pkt[KOM_SAMP_HEADER + 4];
+    size_t len;
+};
+
+struct query_peer {
+    uint32_t ip;
+    uint16_t port;
+    int target;
+};
+
+static double query_ms(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e3 + (b->tv_nsec - a->tv_nsec) / 1e6;
+}
+
+static int peer_cmp(const void *a, const void *b) {
+    const struct query_peer *x = a, *y = b;
+    if (x->ip != y->ip)
+        return x->ip < y->ip ? -1 : 1;
+    return (int)x->port - (int)y->port;
+}
+
+/* ---- reply parsing ---- */
+
+struct query_reader {
+    const unsigned char *p, *end;
+    int bad;
+};
+
+static unsigned query_u(struct query_reader *r, int bytes) {
+    unsigned v = 0;
+    if (r->end - r->p < bytes) {
+        r->bad = 1;
+        return 0;
+    }
+    for (int i = 0; i < bytes; i++)
+        v |= (unsigned)r->p[i] << (8 * i);
+    r->p += bytes;
+    return v;
+}
+
+static void query_str(struct query_reader *r, unsigned len, char *out, size_t size) {
+    if ((unsigned)(r->end - r->p) < len) {
+        r->bad = 1;
+        len = (unsigned)(r->end - r->p);
+    }
+    snprintf(out, size, "%.*s", (int)len, (const char *)r->p);
+    r->p += len;
+}
+
+static void query_parse(struct kom_query_result *res, char op,
+                        const unsigned char *data, size_t len)
+{
+    struct query_reader r = { data, data + len, 0 };
+
+    switch (op) {
+    case 'i':
+        res->password = (int)query_u(&r, 1);
+        res->players = (int)query_u(&r, 2);
+        res->max_players = (int)query_u(&r, 2);
+        query_str(&r, query_u(&r, 4), res->hostname, sizeof(res->hostname));
+        query_str(&r, query_u(&r, 4), res->gamemode, sizeof(res->gamemode));
+        query_str(&r, query_u(&r, 4), res->language, sizeof(res->language));
+        res->online = 1;
+        break;
+    case 'r': {
+        unsigned count = query_u(&r, 2);
+        for (unsigned i = 0; i < count && !r.bad && res->nrules < KOM_QUERY_RULES; i++) {
+            query_str(&r, query_u(&r, 1), res->rules[res->nrules].name, sizeof(res->rules[0].name));
+            query_str(&r, query_u(&r, 1), res->rules[res->nrules].value, sizeof(res->rules[0].value));
+            if (!r.bad)
+                res->nrules++;
+        }
+        break;
+    }
+    case 'c': {
+        unsigned count = query_u(&r, 2);
+        for (unsigned i = 0; i < count && !r.bad && res->nclients < KOM_QUERY_CLIENTS; i++) {
+            query_str(&r, query_u(&r, 1), res->clients[res->nclients].name, sizeof(res->clients[0].name));
+            res->clients[res->nclients].score = (int)query_u(&r, 4);
+            if (!r.bad)
+                res->nclients++;
+        }
+        break;
+    }
+    }
+}
+
+/* ---- engine ---- */
+
+int kom_query_run(const struct kom_rcon_target *t, int n, struct kom_query_result *out,
+                  int timeout_ms, int retries)
+{
+    struct query_req *reqs = calloc((size_t)n * QUERY_OPS, sizeof(*reqs));
+    struct query_peer *peers = calloc((size_t)n, sizeof(*peers));
+    static unsigned char rbuf[QUERY_BATCH][QUERY_RECV_SIZE];
+    int fd = -1, ep = -1, npeers = 0, pending = 0, answered = 0;
+
+    if (reqs == NULL || peers == NULL)
+        goto out;
+
+    for (int i = 0; i < n; i++) {
+        struct sockaddr_in addr;
+        memset(&out[i], 0, sizeof(out[i]));
+        snprintf(out[i].host, sizeof(out[i].host), "%s", t[i].host);
+        out[i].port = t[i].port;
+        out[i].ping_ms = -1;
+        if (kom_samp_resolve(t[i].host, t[i].port, &addr) != 0)
+            continue;
+
+        peers[npeers].ip = addr.sin_addr.s_addr;
+        peers[npeers].port = addr.sin_port;
+        peers[npeers].target = i;
+        npeers++;
+
+        for (int o = 0; o < QUERY_OPS; o++) {
+            struct query_req *q = &reqs[i * QUERY_OPS + o];
+            q->target = i;
+            q->op = query_ops[o];
+            q->len = kom_samp_header(q->pkt, &addr, q->op);
+            if (q->op == 'p') {
+                uint32_t cookie = (uint32_t)rand();
+                memcpy(q->pkt + q->len, &cookie, 4);
+                q->len += 4;
+            }
+            pending++;
+        }
+    }
+    for (int i = 0; i < n * QUERY_OPS; i++) {
+        if (reqs[i].len == 0)
+            reqs[i].done = 1;   /* unresolved target */
+    }
+    qsort(peers, (size_t)npeers, sizeof(*peers), peer_cmp);
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    ep = epoll_create1(EPOLL_CLOEXEC);
+    if (fd < 0 || ep < 0)
+        goto out;
+
+    /* hundreds of servers answer in the same few milliseconds */
+    int rcvbuf = 4 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+
+    while (pending > 0) {
+        struct mmsghdr msgs[QUERY_BATCH];
+        struct iovec iov[QUERY_BATCH];
+        struct sockaddr_in addrs[QUERY_BATCH];
+        struct query_req *batch[QUERY_BATCH];
+        struct timespec now;
+        int nb = 0, wait = timeout_ms;
+
+        /* (re)send everything that is due, expire what ran out of retries */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for (int i = 0; i < n * QUERY_OPS; i++) {
+            struct query_req *q = &reqs[i];
+            if (q->done)
+                continue;
+            if (q->tries > 0) {
+                int left = timeout_ms - (int)query_ms(&q->sent, &now);
+                if (left > 0) {
+                    if (left < wait) wait = left;
+                    continue;
+                }
+                if (q->tries > retries) {
+                    q->done = 1;
+                    pending--;
+                    continue;
+                }
+            }
+            if (nb == QUERY_BATCH) {
+                wait = 0;
+                continue;
+            }
+            memset(&addrs[nb], 0, sizeof(addrs[nb]));
+            addrs[nb].sin_family = AF_INET;
+            memcpy(&addrs[nb].sin_addr.s_addr, q->pkt + 4, 4);
+            addrs[nb].sin_port = htons((uint16_t)(q->pkt[8] | q->pkt[9] << 8));
+            iov[nb].iov_base = q->pkt;
+            iov[nb].iov_len = q->len;
+            memset(&msgs[nb], 0, sizeof(msgs[nb]));
+            msgs[nb].msg_hdr.msg_name = &addrs[nb];
+            msgs[nb].msg_hdr.msg_namelen = sizeof(addrs[nb]);
+            msgs[nb].msg_hdr.msg_iov = &iov[nb];
+            msgs[nb].msg_hdr.msg_iovlen = 1;
+            batch[nb++] = q;
+        }
+        if (nb > 0) {
+            int sent = sendmmsg(fd, msgs, (unsigned)nb, 0);
+            for (int i = 0; i < (sent > 0 ? sent : 0); i++) {
+                batch[i]->tries++;
+                batch[i]->sent = now;
+            }
+            /* send buffer full: the rest goes out on the next pass */
+            if (sent < nb)
+                wait = 1;
+            else if (timeout_ms < wait)
+                wait = timeout_ms;
+        }
+        if (pending == 0)
+            break;
+
+        struct epoll_event events[1];
+        if (epoll_wait(ep, events, 1, wait) <= 0)
+            continue;
+
+        for (;;) {
+            struct mmsghdr rmsgs[QUERY_BATCH];
+            struct iovec riov[QUERY_BATCH];
+            struct sockaddr_in from[QUERY_BATCH];
+
+            memset(rmsgs, 0, sizeof(rmsgs));
+            for (int i = 0; i < QUERY_BATCH; i++) {
+                riov[i].iov_base = rbuf[i];
+                riov[i].iov_len = QUERY_RECV_SIZE;
+                rmsgs[i].msg_hdr.msg_name = &from[i];
+                rmsgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+                rmsgs[i].msg_hdr.msg_iov = &riov[i];
+                rmsgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            int got = recvmmsg(fd, rmsgs, QUERY_BATCH, MSG_DONTWAIT, NULL);
+            if (got <= 0)
+                break;
+
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            for (int i = 0; i < got; i++) {
+                const unsigned char *b = rbuf[i];
+                size_t len = rmsgs[i].msg_len;
+                if (len < KOM_SAMP_HEADER || memcmp(b, "SAMP", 4) != 0)
+                    continue;
+
+                int o = 0;
+                while (o < QUERY_OPS && query_ops[o] != (char)b[10]) o++;
+                if (o == QUERY_OPS)
+                    continue;
+
+                /* the same server may be listed more than once: answer every copy */
+                struct query_peer key = { from[i].sin_addr.s_addr, from[i].sin_port, 0 };
+                struct query_peer *peer = bsearch(&key, peers, (size_t)npeers, sizeof(*peers), peer_cmp);
+                while (peer && peer > peers && peer_cmp(peer - 1, &key) == 0)
+                    peer--;
+                for (; peer && peer < peers + npeers && peer_cmp(peer, &key) == 0; peer++) {
+                    struct query_req *q = &reqs[peer->target * QUERY_OPS + o];
+                    if (q->done)
+                        continue;
+                    if (q->op == 'p') {
+                        if (len < q->len || memcmp(b + KOM_SAMP_HEADER, q->pkt + KOM_SAMP_HEADER, 4) != 0)
+                            continue;
+                        out[q->target].ping_ms = query_ms(&q->sent, &now);
+                    } else {
+                        query_parse(&out[q->target], q->op, b + KOM_SAMP_HEADER, len - KOM_SAMP_HEADER);
+                    }
+                    q->done = 1;
+                    pending--;
+                }
+            }
+            if (got < QUERY_BATCH)
+                break;
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+        answered += out[i].online;
+out:
+    if (ep >= 0) close(ep);
+    if (fd >= 0) close(fd);
+    free(reqs);
+    free(peers);
+    return answered;
+}
+
+/* ---- export ---- */
+
+static void json_str(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            fprintf(fp, "\\%c", *p);
+        else if (*p < 0x20 || *p >= 0x80)
+            fprintf(fp, "\\u%04x", *p);    /* hostnames are not utf-8 */
+        else
+            fputc(*p, fp);
+    }
+    fputc('"', fp);
+}
+
+static void query_json(FILE *fp, const struct kom_query_result *r, int n) {
+    fprintf(fp, "[\n");
+    for (int i = 0; i < n; i++) {
+        fprintf(fp, "  {\"server\": \"%s:%d\", \"online\": %s", r[i].host, r[i].port,
+                r[i].online ? "true" : "false");
+        if (r[i].ping_ms >= 0)
+            fprintf(fp, ", \"ping_ms\": %.2f", r[i].ping_ms);
+        if (r[i].online) {
+            fprintf(fp, ", \"password\": %s, \"players\": %d, \"max_players\": %d, \"hostname\": ",
+                    r[i].password ? "true" : "false", r[i].players, r[i].max_players);
+            json_str(fp, r[i].hostname);
+            fprintf(fp, ", \"gamemode\": ");
+            json_str(fp, r[i].gamemode);
+            fprintf(fp, ", \"language\": ");
+            json_str(fp, r[i].language);
+        }
+        fprintf(fp, ", \"rules\": {");
+        for (int j = 0; j < r[i].nrules; j++) {
+            fprintf(fp, j ? ", " : "");
+            json_str(fp, r[i].rules[j].name);
+            fprintf(fp, ": ");
+            json_str(fp, r[i].rules[j].value);
+        }
+        fprintf(fp, "}, \"clients\": [");
+        for (int j = 0; j < r[i].nclients; j++) {
+            fprintf(fp, j ? ", {\"name\": " : "{\"name\": ");
+            json_str(fp, r[i].clients[j].name);
+            fprintf(fp, ", \"score\": %d}", r[i].clients[j].score);
+        }
+        fprintf(fp, "]}%s\n", i + 1 < n ? "," : "");
+    }
+    fprintf(fp, "]\n");
+}
+
+/* label values must be utf-8; treat the raw hostname bytes as latin-1 */
+static void prom_label(FILE *fp, const char *s) {
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            fprintf(fp, "\\%c", *p);
+        else if (*p == '\n')
+            fputs("\\n", fp);
+        else if (*p >= 0x80)
+            fprintf(fp, "%c%c", 0xc0 | (*p >> 6), 0x80 | (*p & 0x3f));
+        else
+            fputc(*p, fp);
+    }
+}
+
+static void query_prom(FILE *fp, const struct kom_query_result *r, int n) {
+    static const struct { const char *name, *help; } metrics[] = {
+        { "samp_up", "Whether the server answered the info query." },
+        { "samp_players", "Players online." },
+        { "samp_max_players", "Player slots." },
+        { "samp_ping_ms", "Query round trip in milliseconds." },
+    };
+
+    for (int m = 0; m < 4; m++) {
+        fprintf(fp, "# HELP %s %s\n# TYPE %s gauge\n", metrics[m].name, metrics[m].help, metrics[m].name);
+        for (int i = 0; i < n; i++) {
+            double v = m == 0 ? r[i].online : m == 1 ? r[i].players :
+                       m == 2 ? r[i].max_players : r[i].ping_ms;
+            if ((m == 1 || m == 2) && !r[i].online)
+                continue;
+            if (m == 3 && r[i].ping_ms < 0)
+                continue;
+            fprintf(fp, "%s{server=\"%s:%d\"} %g\n", metrics[m].name, r[i].host, r[i].port, v);
+        }
+    }
+
+    fprintf(fp, "# HELP samp_info Server description.\n# TYPE samp_info gauge\n");
+    for (int i = 0; i < n; i++) {
+        if (!r[i].online)
+            continue;
+        fprintf(fp, "samp_info{server=\"%s:%d\",hostname=\"", r[i].host, r[i].port);
+        prom_label(fp, r[i].hostname);
+        fprintf(fp, "\",gamemode=\"");
+        prom_label(fp, r[i].gamemode);
+        fprintf(fp, "\",language=\"");
+        prom_label(fp, r[i].language);
+        fprintf(fp, "\"} 1\n");
+    }
+}
+
+static void query_table(const struct kom_query_result *r, int n) {
+    for (int i = 0; i < n; i++) {
+        char server[96], ping[16] = "        -";
+        snprintf(server, sizeof(server), "%s:%d", r[i].host, r[i].port);
+        if (!r[i].online) {
+            printf_color(COL_RED, "  %-21s offline", server);
+            continue;
+        }
+        if (r[i].ping_ms >= 0)
+            snprintf(ping, sizeof(ping), "%6.1f ms", r[i].ping_ms);
+        println("  %-21s %3d/%-3d %s  %s  [%s]", server, r[i].players, r[i].max_players,
+                ping, r[i].hostname, r[i].gamemode);
+    }
+}
+
+/*
+ * query [host:port ...] [json|prom [file]]: explicit targets, else
+ * [query] servers / the fleet / the local server as kom_samp_targets
+ * picks them. prom writes through a temporary file and rename(), as the
+ * node_exporter textfile collector expects.
+ */
+int call_query(const char *args) {
+    static struct kom_rcon_target targets[KOM_QUERY_MAX];
+    struct kom_query_result *res;
+    char buf[1024], format[8] = "", file[512] = "";
+    int n = 0, timeout_ms = 1000, retries = 2;
+
+    toml_table_t *conf = kom_toml_load();
+    toml_table_t *query = conf ? toml_table_in(conf, "query") : NULL;
+    if (query) {
+        toml_datum_t v = toml_int_in(query, "timeout_ms");
+        if (v.ok) timeout_ms = (int)v.u.i;
+        v = toml_int_in(query, "retries");
+        if (v.ok) retries = (int)v.u.i;
+    }
+    if (conf)
+        toml_free(conf);
+
+    snprintf(buf, sizeof(buf), "%s", args ? args : "");
+    for (char *tok = strtok(buf, " "); tok; tok = strtok(NULL, " ")) {
+        char *colon = strrchr(tok, ':');
+        if (strcmp(tok, "json") == 0 || strcmp(tok, "prom") == 0) {
+            snprintf(format, sizeof(format), "%s", tok);
+        } else if (format[0]) {
+            snprintf(file, sizeof(file), "%s", tok);
+        } else if (colon && n < KOM_QUERY_MAX) {
+            memset(&targets[n], 0, sizeof(targets[n]));
+            snprintf(targets[n].host, sizeof(targets[n].host), "%.*s", (int)(colon - tok), tok);
+            targets[n++].port = atoi(colon + 1);
+        } else {
+            printf_color(COL_RED, "query: unknown argument \"%s\"", tok);
+            return 1;
+        }
+    }
+    if (n == 0)
+        n = kom_samp_targets("query", targets, KOM_QUERY_MAX);
+    if (strcmp(format, "prom") == 0 && file[0] == '\0') {
+        printf_color(COL_RED, "query: prom needs an output file");
+        return 1;
+    }
+
+    res = calloc((size_t)n, sizeof(*res));
+    if (res == NULL)
+        return 1;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int up = kom_query_run(targets, n, res, timeout_ms, retries);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (format[0] == '\0') {
+        query_table(res, n);
+    } else {
+        char tmp[600];
+        FILE *fp = stdout;
+        snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+        if (file[0] && (fp = fopen(tmp, "w")) == NULL) {
+            printf_color(COL_RED, "query: %s: %s", tmp, strerror(errno));
+            free(res);
+            return 1;
+        }
+        if (format[0] == 'j')
+            query_json(fp, res, n);
+        else
+            query_prom(fp, res, n);
+        if (fp != stdout) {
+            fclose(fp);
+            rename(tmp, file);
+        }
+    }
+    println("query: %d/%d servers answered in %.0f ms", up, n, query_ms(&t0, &t1));
+
+    free(res);
+    return up == n ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/query.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "rcon.h"
+
+#define KOM_QUERY_MAX       1024
+#define KOM_QUERY_RULES     64
+#define KOM_QUERY_CLIENTS   128
+
+struct kom_query_result {
+    char host[64];
+    int port;
+    int online;                 /* answered the info opcode */
+    double ping_ms;             /* 'p' round trip, -1 without an answer */
+    int password;
+    int players, max_players;
+    char hostname[128];
+    char gamemode[64];
+    char language[64];
+    int nrules;
+    struct { char name[32]; char value[64]; } rules[KOM_QUERY_RULES];
+    int nclients;
+    struct { char name[32]; int score; } clients[KOM_QUERY_CLIENTS];
+};
+
+int kom_query_run(const struct kom_rcon_target *t, int n, struct kom_query_result *out,
+                  int timeout_ms, int retries);
+int call_query(const char *args);
+
+#endif
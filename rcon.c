@@ -0,0 +1,511 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/rcon.c
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <limits.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+
+#include "color.h"
+#include "utils.h"
+#include "serve.h"
+#include "fleet.h"
+#include "rcon.h"
+
+/*
+ * SA-MP / open.mp remote console over the query protocol. Every packet
+ * starts with "SAMP", the server's IPv4 address and port (little endian)
+ * and an opcode; RCON is opcode 'x' followed by the password and command,
+ * each prefixed with a 16-bit little endian length. The server answers
+ * with one 'x' packet per console line.
+ */
+
+size_t kom_samp_header(unsigned char *buf, const struct sockaddr_in *addr, char opcode) {
+    uint32_t ip = addr->sin_addr.s_addr;        /* already network order */
+    uint16_t port = ntohs(addr->sin_port);
+
+    memcpy(buf, "SAMP", 4);
+    memcpy(buf + 4, &ip, 4);
+    buf[8] = (unsigned char)(port & 0xff);
+    buf[9] = (unsigned char)(port >> 8);
+    buf[10] = (unsigned char)opcode;
+    return KOM_SAMP_HEADER;
+}
+
+size_t kom_rcon_packet(unsigned char *buf, size_t len, const struct sockaddr_in *addr,
+                       const char *password, const char *cmd)
+{
+    size_t plen = strlen(password), clen = strlen(cmd);
+    size_t n = KOM_SAMP_HEADER;
+
+    if (n + 4 + plen + clen > len)
+        return 0;
+    kom_samp_header(buf, addr, 'x');
+    buf[n++] = (unsigned char)(plen & 0xff);
+    buf[n++] = (unsigned char)(plen >> 8);
+    memcpy(buf + n, password, plen);
+    n += plen;
+    buf[n++] = (unsigned char)(clen & 0xff);
+    buf[n++] = (unsigned char)(clen >> 8);
+    memcpy(buf + n, cmd, clen);
+    return n + clen;
+}
+
+int kom_samp_resolve(const char *host, int port, struct sockaddr_in *addr) {
+    struct addrinfo hints = { 0 }, *res = NULL;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &addr->sin_addr) == 1)
+        return 0;
+
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, NULL, &hints, &res) != 0 || res == NULL)
+        return -1;
+    addr->sin_addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+    return 0;
+}
+
+/*
+ * Take port and rcon_password from dir/server.cfg, or from the "network"
+ * and "rcon" sections of an open.mp config.json.
+ */
+int kom_rcon_from_dir(struct kom_rcon_target *t, const char *dir) {
+    char path[1024], line[512];
+    FILE *fp;
+
+    memset(t, 0, sizeof(*t));
+    snprintf(t->host, sizeof(t->host), "127.0.0.1");
+    t->port = 7777;
+
+    snprintf(path, sizeof(path), "%s/server.cfg", dir);
+    if ((fp = fopen(path, "r")) != NULL) {
+        while (fgets(line, sizeof(line), fp)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (strncmp(line, "port ", 5) == 0)
+                t->port = atoi(line + 5);
+            else if (strncmp(line, "rcon_password ", 14) == 0 &&
+                     snprintf(t->password, sizeof(t->password), "%s", line + 14) >= (int)sizeof(t->password))
+                t->password[0] = '\0';     /* a cut-off password would only be rejected */
+        }
+        fclose(fp);
+        return t->password[0] ? 0 : -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/config.json", dir);
+    if ((fp = fopen(path, "r")) != NULL) {
+        char json[65536];
+        size_t n = fread(json, 1, sizeof(json) - 1, fp);
+        fclose(fp);
+        json[n] = '\0';
+
+        char *net = strstr(json, "\"network\"");
+        char *port = strstr(net ? net : json, "\"port\"");
+        if (port && (port = strchr(port + 6, ':')))
+            t->port = atoi(port + 1);
+
+        char *rcon = strstr(json, "\"rcon\"");
+        char *pw = rcon ? strstr(rcon, "\"password\"") : NULL;
+        if (pw && (pw = strchr(pw + 10, ':')) && (pw = strchr(pw, '"'))) {
+            char *end = strchr(++pw, '"');
+            if (end)
+                snprintf(t->password, sizeof(t->password), "%.*s", (int)(end - pw), pw);
+        }
+    }
+    return t->password[0] ? 0 : -1;
+}
+
+/*
+ * The servers a fan-out command talks to: [section] servers = ["host:port"]
+ * in komodo.toml, else every fleet instance, else the local server.
+ * [section] password fills in targets that have none of their own.
+ */
+int kom_samp_targets(const char *section, struct kom_rcon_target *t, int max) {
+    toml_table_t *conf = kom_toml_load();
+    toml_table_t *tab = conf ? toml_table_in(conf, section) : NULL;
+    toml_array_t *servers = tab ? toml_array_in(tab, "servers") : NULL;
+    char password[64] = "", path[PATH_MAX];
+    struct stat st;
+    int n = 0;
+
+    kom_toml_string(tab, "password", password, sizeof(password));
+
+    for (int i = 0; servers && i < toml_array_nelem(servers) && n < max; i++) {
+        toml_datum_t v = toml_string_at(servers, i);
+        if (!v.ok)
+            continue;
+        char *colon = strrchr(v.u.s, ':');
+        memset(&t[n], 0, sizeof(t[n]));
+        snprintf(t[n].host, sizeof(t[n].host), "%.*s",
+                 colon ? (int)(colon - v.u.s) : (int)strlen(v.u.s), v.u.s);
+        t[n].port = colon ? atoi(colon + 1) : 7777;
+        free(v.u.s);
+        n++;
+    }
+
+    if (servers == NULL) {
+        for (int i = 0; n < max; i++) {
+            snprintf(path, sizeof(path), KOM_FLEET_DIR "/instance-%d", i);
+            if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+                break;
+            kom_rcon_from_dir(&t[n++], path);
+        }
+    }
+    if (n == 0 && max > 0) {
+        struct kom_server srv;
+        toml_table_t *serve = conf ? toml_table_in(conf, "serve") : NULL;
+        kom_rcon_from_dir(&t[n++], kom_server_locate(&srv, serve) == 0 ? srv.dir : ".");
+    }
+    if (conf)
+        toml_free(conf);
+
+    for (int i = 0; i < n; i++) {
+        if (t[i].password[0] == '\0')
+            snprintf(t[i].password, sizeof(t[i].password), "%s", password);
+    }
+    return n;
+}
+
+/*
+ * Send one command and print whatever the server answers within wait_ms.
+ * Returns the number of reply lines, or -1 when the port is closed.
+ */
+int kom_rcon_send(const struct kom_rcon_target *t, const char *cmd, int wait_ms) {
+    struct sockaddr_in addr;
+    unsigned char buf[KOM_SAMP_PACKET];
+    size_t len;
+    int fd, lines = 0;
+
+    if (kom_samp_resolve(t->host, t->port, &addr) != 0) {
+        printf_color(COL_RED, "rcon: cannot resolve %s", t->host);
+        return -1;
+    }
+    if ((len = kom_rcon_packet(buf, sizeof(buf), &addr, t->password, cmd)) == 0)
+        return -1;
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        send(fd, buf, len, 0) != (ssize_t)len) {
+        printf_color(COL_RED, "rcon: %s:%d: %s", t->host, t->port, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    struct pollfd p = { .fd = fd, .events = POLLIN };
+    while (poll(&p, 1, wait_ms) > 0) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == ECONNREFUSED) {
+            lines = -1;     /* nothing listening on that port */
+            break;
+        }
+        if (n < KOM_SAMP_HEADER + 2 || memcmp(buf, "SAMP", 4) != 0 || buf[10] != 'x')
+            break;
+        size_t tl = (size_t)buf[11] | (size_t)buf[12] << 8;
+        if (tl > (size_t)n - 13)
+            tl = (size_t)n - 13;
+        println("%.*s", (int)tl, (const char *)buf + 13);
+        lines++;
+    }
+
+    close(fd);
+    return lines;
+}
+
+/*
+ * Pipelined RCON over many servers. Every (server, command) packet goes
+ * out from one non-blocking socket in sendmmsg batches, so a fleet-wide
+ * command costs one round trip instead of one per server. RCON replies
+ * carry no request id, so a server only gets its next command once the
+ * previous one has answered and gone quiet for RCON_QUIET_MS, or wait_ms
+ * passed without an answer; replies are credited to the one command that
+ * is outstanding. Commands are also spaced at least 1000/rate ms apart.
+ */
+
+#define RCON_BATCH     64
+#define RCON_QUIET_MS  100
+
+struct rcon_peer {
+    struct sockaddr_in addr;
+    int next;                   /* next command to send */
+    struct timespec due;        /* earliest time for it */
+    struct timespec sent;       /* when the outstanding command went out */
+    struct timespec last;       /* last send or reply */
+    int heard;                  /* the outstanding command got a reply */
+    int replies;
+    char *out;                  /* collected reply lines */
+    size_t outlen;
+};
+
+static double rcon_ms(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e3 + (b->tv_nsec - a->tv_nsec) / 1e6;
+}
+
+static void rcon_after(struct timespec *ts, const struct timespec *from, int ms) {
+    ts->tv_sec = from->tv_sec + ms / 1000;
+    ts->tv_nsec = from->tv_nsec + (long)(ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void rcon_append(struct rcon_peer *p, const char *cmd, const char *text, size_t len) {
+    size_t need = p->outlen + strlen(cmd) + len + 8;
+    char *out = realloc(p->out, need);
+    if (out == NULL)
+        return;
+    p->out = out;
+    p->outlen += (size_t)snprintf(out + p->outlen, need - p->outlen, "[%s] %.*s\n", cmd, (int)len, text);
+}
+
+int kom_rcon_batch(const struct kom_rcon_target *t, int n, char **cmds, int ncmds,
+                   int rate, int wait_ms)
+{
+    struct rcon_peer *peers = calloc((size_t)n, sizeof(*peers));
+    static unsigned char pkts[RCON_BATCH][KOM_SAMP_PACKET];
+    unsigned char rbuf[RCON_BATCH][KOM_SAMP_PACKET];
+    struct timespec start, now;
+    int fd = -1, ep = -1, replied = 0, active = 0;
+    int gap = rate > 0 ? 1000 / rate : 0;
+
+    if (peers == NULL)
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < n; i++) {
+        peers[i].due = peers[i].last = start;
+        if (kom_samp_resolve(t[i].host, t[i].port, &peers[i].addr) != 0) {
+            printf_color(COL_RED, "rcon: cannot resolve %s", t[i].host);
+            peers[i].next = ncmds;
+        } else if (t[i].password[0] == '\0') {
+            printf_color(COL_YELLOW, "rcon: %s:%d has no rcon password, skipped", t[i].host, t[i].port);
+            peers[i].next = ncmds;
+        } else {
+            active++;
+        }
+    }
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    ep = epoll_create1(EPOLL_CLOEXEC);
+    if (fd < 0 || ep < 0)
+        goto out;
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+
+    int blocked = 0;
+    while (active > 0) {
+        struct mmsghdr msgs[RCON_BATCH];
+        struct iovec iov[RCON_BATCH];
+        int who[RCON_BATCH], nb = 0, wait = wait_ms;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        active = 0;
+        for (int i = 0; i < n; i++) {
+            struct rcon_peer *p = &peers[i];
+            if (p->next >= ncmds) {
+                /* everything sent: linger wait_ms after the last traffic */
+                int left = wait_ms - (int)rcon_ms(&p->last, &now);
+                if (p->next == ncmds && left > 0) {
+                    active++;
+                    if (left < wait) wait = left;
+                }
+                continue;
+            }
+            active++;
+            int left = (int)rcon_ms(&now, &p->due);
+            if (p->next > 0) {
+                /* hold the next command until the previous one is answered */
+                int hold = wait_ms - (int)rcon_ms(&p->sent, &now);
+                int quiet = (RCON_QUIET_MS < wait_ms ? RCON_QUIET_MS : wait_ms) -
+                            (int)rcon_ms(&p->last, &now);
+                if (p->heard && quiet < hold)
+                    hold = quiet;
+                if (hold > left)
+                    left = hold;
+            }
+            if (left > 0 || nb == RCON_BATCH) {
+                if (left < wait) wait = left > 0 ? left : 0;
+                continue;
+            }
+            size_t len = kom_rcon_packet(pkts[nb], KOM_SAMP_PACKET, &p->addr, t[i].password, cmds[p->next]);
+            if (len == 0) {
+                p->next++;      /* command does not fit a datagram */
+                continue;
+            }
+            iov[nb].iov_base = pkts[nb];
+            iov[nb].iov_len = len;
+            memset(&msgs[nb], 0, sizeof(msgs[nb]));
+            msgs[nb].msg_hdr.msg_name = &p->addr;
+            msgs[nb].msg_hdr.msg_namelen = sizeof(p->addr);
+            msgs[nb].msg_hdr.msg_iov = &iov[nb];
+            msgs[nb].msg_hdr.msg_iovlen = 1;
+            who[nb++] = i;
+        }
+
+        if (nb > 0) {
+            int sent = sendmmsg(fd, msgs, (unsigned)nb, 0);
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                printf_color(COL_RED, "rcon: %s:%d: %s", t[who[0]].host, t[who[0]].port, strerror(errno));
+                peers[who[0]].next = ncmds + 1;     /* give up on that server */
+                continue;
+            }
+            for (int k = 0; k < (sent > 0 ? sent : 0); k++) {
+                struct rcon_peer *p = &peers[who[k]];
+                p->next++;
+                p->sent = p->last = now;
+                p->heard = 0;
+                rcon_after(&p->due, &now, gap);
+                if (gap < wait) wait = gap;
+            }
+            /*
+             * Send buffer full: sleep until it drains, reading whatever
+             * replies arrive meanwhile, instead of spinning on sendmmsg.
+             */
+            if ((sent < nb) != blocked) {
+                blocked = sent < nb;
+                ev.events = blocked ? EPOLLIN | EPOLLOUT : EPOLLIN;
+                epoll_ctl(ep, EPOLL_CTL_MOD, fd, &ev);
+            }
+            if (blocked)
+                wait = wait_ms;
+        } else if (blocked) {
+            blocked = 0;
+            ev.events = EPOLLIN;
+            epoll_ctl(ep, EPOLL_CTL_MOD, fd, &ev);
+        }
+        if (active == 0)
+            break;
+
+        struct epoll_event events[1];
+        if (epoll_wait(ep, events, 1, wait) <= 0)
+            continue;
+
+        for (;;) {
+            struct mmsghdr rmsgs[RCON_BATCH];
+            struct iovec riov[RCON_BATCH];
+            struct sockaddr_in from[RCON_BATCH];
+
+            memset(rmsgs, 0, sizeof(rmsgs));
+            for (int k = 0; k < RCON_BATCH; k++) {
+                riov[k].iov_base = rbuf[k];
+                riov[k].iov_len = KOM_SAMP_PACKET;
+                rmsgs[k].msg_hdr.msg_name = &from[k];
+                rmsgs[k].msg_hdr.msg_namelen = sizeof(from[k]);
+                rmsgs[k].msg_hdr.msg_iov = &riov[k];
+                rmsgs[k].msg_hdr.msg_iovlen = 1;
+            }
+            int got = recvmmsg(fd, rmsgs, RCON_BATCH, MSG_DONTWAIT, NULL);
+            if (got <= 0)
+                break;
+
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            for (int k = 0; k < got; k++) {
+                size_t len = rmsgs[k].msg_len;
+                if (len < KOM_SAMP_HEADER + 2 || memcmp(rbuf[k], "SAMP", 4) != 0 || rbuf[k][10] != 'x')
+                    continue;
+                for (int i = 0; i < n; i++) {
+                    struct rcon_peer *p = &peers[i];
+                    if (p->addr.sin_addr.s_addr != from[k].sin_addr.s_addr ||
+                        p->addr.sin_port != from[k].sin_port || p->next == 0)
+                        continue;
+                    size_t tl = (size_t)rbuf[k][11] | (size_t)rbuf[k][12] << 8;
+                    if (tl > len - 13)
+                        tl = len - 13;
+                    rcon_append(p, cmds[p->next - 1], (const char *)rbuf[k] + 13, tl);
+                    p->replies++;
+                    p->heard = 1;
+                    p->last = now;
+                    break;
+                }
+            }
+            if (got < RCON_BATCH)
+                break;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (int i = 0; i < n; i++) {
+        if (peers[i].replies == 0) {
+            printf_color(COL_YELLOW, "== %s:%d: no reply", t[i].host, t[i].port);
+            continue;
+        }
+        replied++;
+        println("== %s:%d", t[i].host, t[i].port);
+        printf("%s", peers[i].out);
+    }
+    println("rcon: %d command(s) to %d server(s), %d replied, %.0f ms",
+            ncmds, n, replied, rcon_ms(&start, &now));
+
+out:
+    if (ep >= 0) close(ep);
+    if (fd >= 0) close(fd);
+    for (int i = 0; i < n; i++)
+        free(peers[i].out);
+    free(peers);
+    return replied;
+}
+
+/*
+ * rcon <command>[; <command> ...] against [rcon] servers, the fleet or
+ * the local server; [rcon] rate caps commands per second per server and
+ * [rcon] wait_ms is how long to collect replies after the last one.
+ */
+int call_rcon(const char *args) {
+    static struct kom_rcon_target targets[KOM_RCON_MAX];
+    char buf[1024], *cmds[32];
+    int ncmds = 0, rate = 10, wait_ms = 500;
+
+    while (args && *args == ' ')
+        args++;
+    if (args == NULL || *args == '\0') {
+        println("usage: rcon <command>[; <command> ...]");
+        return 1;
+    }
+
+    toml_table_t *conf = kom_toml_load();
+    toml_table_t *rcon = conf ? toml_table_in(conf, "rcon") : NULL;
+    if (rcon) {
+        toml_datum_t v = toml_int_in(rcon, "rate");
+        if (v.ok) rate = (int)v.u.i;
+        v = toml_int_in(rcon, "wait_ms");
+        if (v.ok) wait_ms = (int)v.u.i;
+    }
+    if (conf)
+        toml_free(conf);
+
+    snprintf(buf, sizeof(buf), "%s", args);
+    for (char *tok = strtok(buf, ";"); tok && ncmds < 32; tok = strtok(NULL, ";")) {
+        while (*tok == ' ') tok++;
+        char *end = tok + strlen(tok);
+        while (end > tok && end[-1] == ' ') *--end = '\0';
+        if (*tok)
+            cmds[ncmds++] = tok;
+    }
+
+    int n = kom_samp_targets("rcon", targets, KOM_RCON_MAX);
+    int replied = kom_rcon_batch(targets, n, cmds, ncmds, rate, wait_ms);
+    return replied == n ? 0 : 1;
+}
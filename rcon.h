@@ -0,0 +1,38 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/rcon.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef RCON_H
+#define RCON_H
+
+#include <stddef.h>
+#include <netinet/in.h>
+
+#define KOM_SAMP_HEADER  11      /* "SAMP" + ipv4 + port + opcode */
+#define KOM_SAMP_PACKET  1500
+#define KOM_RCON_MAX     1024
+
+struct kom_rcon_target {
+    char host[64];
+    int port;
+    char password[64];
+};
+
+size_t kom_samp_header(unsigned char *buf, const struct sockaddr_in *addr, char opcode);
+size_t kom_rcon_packet(unsigned char *buf, size_t len, const struct sockaddr_in *addr,
+                       const char *password, const char *cmd);
+int kom_samp_resolve(const char *host, int port, struct sockaddr_in *addr);
+int kom_rcon_from_dir(struct kom_rcon_target *t, const char *dir);
+int kom_samp_targets(const char *section, struct kom_rcon_target *t, int max);
+int kom_rcon_send(const struct kom_rcon_target *t, const char *cmd, int wait_ms);
+int kom_rcon_batch(const struct kom_rcon_target *t, int n, char **cmds, int ncmds,
+                   int rate, int wait_ms);
+int call_rcon(const char *args);
+
+#endif
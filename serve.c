@@ -0,0 +1,509 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/serve.c
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+
+#include "color.h"
+#include "utils.h"
+#include "serve.h"
+
+/*
+ * `serve`: run samp03svr / omp-server under supervision. The child is
+ * watched through a pidfd, its console through a pipe, SIGINT/SIGTERM
+ * through a signalfd and restart delays through a timerfd, all in one
+ * epoll set, so a crash is noticed the instant the process dies.
+ *
+ * Warm standby: a second child is forked ahead of time with its working
+ * directory, stdio and the server binary/plugins already paged in, then
+ * parks on a gate pipe right before execve. On a crash the gate is opened
+ * and the standby becomes the server without paying fork + cold page
+ * cache. It cannot go further than that: both processes would fight over
+ * the same UDP port.
+ */
+
+#define SERVE_BACKOFF_MAX   30      /* seconds */
+#define SERVE_STABLE        60      /* uptime that resets the backoff */
+#define SERVE_STOP_GRACE    5       /* seconds before SIGKILL on stop */
+
+struct serve_proc {
+    pid_t pid;
+    int pidfd;
+    int out;                /* read end of the console pipe */
+    int gate;               /* standby only: write end of the exec gate */
+    int64_t started_ns;     /* spawn, or gate release for a standby */
+    int ready;
+    char line[1024];
+    size_t line_len;
+};
+
+struct serve_stats {
+    time_t since;
+    int restarts;
+    int crashes;
+    double uptime_total;
+    double last_uptime;
+    double last_ready_ms;
+};
+
+static const char *__server_names[] = { "omp-server", "samp03svr", "samp03DLsvr" };
+static const char *__server_dirs[] = { ".", "Server", "samp03" };
+
+static int64_t serve_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Fill srv from [serve] (dir, binary, ready) or find an installed server
+ * in the directories the SA-MP and open.mp archives unpack to.
+ */
+int kom_server_locate(struct kom_server *srv, toml_table_t *serve) {
+    char path[1024];
+
+    memset(srv, 0, sizeof(*srv));
+    kom_toml_string(serve, "dir", srv->dir, sizeof(srv->dir));
+    kom_toml_string(serve, "binary", srv->binary, sizeof(srv->binary));
+    if (!kom_toml_string(serve, "ready", srv->ready, sizeof(srv->ready)))
+        snprintf(srv->ready, sizeof(srv->ready), "on port");
+
+    if (srv->dir[0] && srv->binary[0])
+        return 0;
+
+    for (int d = 0; d < 3; d++) {
+        if (srv->dir[0] && strcmp(srv->dir, __server_dirs[d]) != 0)
+            continue;
+        for (int b = 0; b < 3; b++) {
+            if (srv->binary[0] && strcmp(srv->binary, __server_names[b]) != 0)
+                continue;
+            snprintf(path, sizeof(path), "%s/%s", __server_dirs[d], __server_names[b]);
+            if (access(path, X_OK) == 0) {
+                snprintf(srv->dir, sizeof(srv->dir), "%s", __server_dirs[d]);
+                snprintf(srv->binary, sizeof(srv->binary), "%s", __server_names[b]);
+                return 0;
+            }
+        }
+    }
+
+    if (srv->dir[0] && srv->binary[0])
+        return 0;
+    return -1;
+}
+
+/* Pull the server binary and its plugins into the page cache */
+static void serve_warm_pages(const struct kom_server *srv) {
+    const char *dirs[] = { "plugins", "components" };
+    char path[1024];
+    int fd;
+
+    if ((fd = open(srv->binary, O_RDONLY | O_CLOEXEC)) >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        DIR *dir = opendir(dirs[i]);
+        struct dirent *ent;
+        if (dir == NULL)
+            continue;
+        while ((ent = readdir(dir)) != NULL) {
+            if (ent->d_name[0] == '.')
+                continue;
+            snprintf(path, sizeof(path), "%s/%s", dirs[i], ent->d_name);
+            if ((fd = open(path, O_RDONLY | O_CLOEXEC)) >= 0) {
+                posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+                close(fd);
+            }
+        }
+        closedir(dir);
+    }
+}
+
+static int serve_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+ * Fork a server child. A standby stops right before execve until its gate
+ * is written to; closing the gate instead makes it exit quietly.
+ */
+static int serve_spawn(const struct kom_server *srv, struct serve_proc *p,
+                       int standby, const sigset_t *child_mask)
+{
+    int outp[2], gate[2] = { -1, -1 };
+
+    memset(p, 0, sizeof(*p));
+    p->pidfd = p->out = p->gate = -1;
+
+    if (pipe2(outp, O_CLOEXEC) != 0)
+        return -1;
+    if (standby && pipe2(gate, O_CLOEXEC) != 0) {
+        close(outp[0]);
+        close(outp[1]);
+        return -1;
+    }
+
+    p->pid = fork();
+    if (p->pid < 0) {
+        close(outp[0]);
+        close(outp[1]);
+        if (standby) {
+            close(gate[0]);
+            close(gate[1]);
+        }
+        return -1;
+    }
+
+    if (p->pid == 0) {
+        /* own process group: Ctrl-C goes to komodo, which decides */
+        setpgid(0, 0);
+        sigprocmask(SIG_SETMASK, child_mask, NULL);
+
+        int devnull = open("/dev/null", O_RDONLY);
+        if (devnull >= 0)
+            dup2(devnull, STDIN_FILENO);
+        dup2(outp[1], STDOUT_FILENO);
+        dup2(outp[1], STDERR_FILENO);
+
+        if (chdir(srv->dir) != 0)
+            _exit(127);
+
+        if (standby) {
+            char c;
+            serve_warm_pages(srv);
+            close(gate[1]);
+            if (read(gate[0], &c, 1) != 1)
+                _exit(0);
+        }
+
+        char exe[160];
+        snprintf(exe, sizeof(exe), "./%s", srv->binary);
+        execl(exe, srv->binary, (char *)NULL);
+        _exit(127);
+    }
+
+    close(outp[1]);
+    p->out = outp[0];
+    fcntl(p->out, F_SETFL, fcntl(p->out, F_GETFL) | O_NONBLOCK);
+    if (standby) {
+        close(gate[0]);
+        p->gate = gate[1];
+    }
+    p->pidfd = serve_pidfd(p->pid);
+    p->started_ns = serve_now_ns();
+    return 0;
+}
+
+static void serve_close(struct serve_proc *p) {
+    if (p->out >= 0) close(p->out);
+    if (p->pidfd >= 0) close(p->pidfd);
+    if (p->gate >= 0) close(p->gate);
+    memset(p, 0, sizeof(*p));
+    p->pidfd = p->out = p->gate = -1;
+}
+
+static void serve_stats_write(const struct serve_stats *st) {
+    FILE *fp;
+
+    kom_mkdir_p(".komodo");
+    fp = fopen(KOM_SERVE_STATS, "w");
+    if (fp == NULL)
+        return;
+    fprintf(fp, "since = %ld\n", (long)st->since);
+    fprintf(fp, "restarts = %d\n", st->restarts);
+    fprintf(fp, "crashes = %d\n", st->crashes);
+    fprintf(fp, "uptime_total = %.1f\n", st->uptime_total);
+    fprintf(fp, "last_uptime = %.1f\n", st->last_uptime);
+    fprintf(fp, "last_ready_ms = %.0f\n", st->last_ready_ms);
+    fclose(fp);
+}
+
+/*
+ * Forward console output and watch for the ready marker. At EOF the pipe
+ * leaves the epoll set and is closed, or its EPOLLHUP would fire forever.
+ */
+static void serve_drain(int ep, struct serve_proc *p, const struct kom_server *srv,
+                        struct serve_stats *st)
+{
+    char buf[4096];
+    ssize_t n = -1;
+
+    while (p->out >= 0 && (n = read(p->out, buf, sizeof(buf))) > 0) {
+        fwrite(buf, 1, (size_t)n, stdout);
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] != '\n') {
+                if (p->line_len + 1 < sizeof(p->line))
+                    p->line[p->line_len++] = buf[i];
+                continue;
+            }
+            p->line[p->line_len] = '\0';
+            p->line_len = 0;
+            if (!p->ready && strcasestr(p->line, srv->ready)) {
+                p->ready = 1;
+                st->last_ready_ms = (double)(serve_now_ns() - p->started_ns) / 1e6;
+                printf_color(COL_GREEN, "serve: ready in %.0f ms", st->last_ready_ms);
+                serve_stats_write(st);
+            }
+        }
+    }
+    if (p->out >= 0 && n == 0) {
+        epoll_ctl(ep, EPOLL_CTL_DEL, p->out, NULL);
+        close(p->out);
+        p->out = -1;
+    }
+    fflush(stdout);
+}
+
+static void serve_watch(int ep, struct serve_proc *p) {
+    struct epoll_event ev = { .events = EPOLLIN };
+
+    ev.data.fd = p->out;
+    epoll_ctl(ep, EPOLL_CTL_ADD, p->out, &ev);
+    if (p->pidfd >= 0) {
+        ev.data.fd = p->pidfd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, p->pidfd, &ev);
+    }
+}
+
+/* Standbys are only watched for exit; their console is read once promoted */
+static int serve_spawn_standby(int ep, const struct kom_server *srv,
+                               struct serve_proc *p, const sigset_t *child_mask)
+{
+    struct epoll_event ev = { .events = EPOLLIN };
+
+    if (serve_spawn(srv, p, 1, child_mask) != 0)
+        return -1;
+    if (p->pidfd >= 0) {
+        ev.data.fd = p->pidfd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, p->pidfd, &ev);
+    }
+    return 0;
+}
+
+static void serve_arm(int tfd, double secs) {
+    struct itimerspec its = { 0 };
+    its.it_value.tv_sec = (time_t)secs;
+    its.it_value.tv_nsec = (long)((secs - (double)(time_t)secs) * 1e9);
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+        its.it_value.tv_nsec = 1;
+    timerfd_settime(tfd, 0, &its, NULL);
+}
+
+/* Reap p if it has exited; returns 1 with its wait status when it did */
+static int serve_reap(struct serve_proc *p, int *status) {
+    if (p->pid <= 0)
+        return 0;
+    return waitpid(p->pid, status, WNOHANG) == p->pid;
+}
+
+int call_serve(void) {
+    struct kom_server srv;
+    struct serve_stats st = { 0 };
+    struct serve_proc cur, spare;
+    sigset_t mask, oldmask;
+    int standby = 0, always = 0, stopping = 0, backoff = 0;
+
+    toml_table_t *conf = kom_toml_load();
+    toml_table_t *serve = conf ? toml_table_in(conf, "serve") : NULL;
+    int found = kom_server_locate(&srv, serve);
+    if (serve) {
+        toml_datum_t v = toml_bool_in(serve, "standby");
+        char policy[32] = "on-failure";
+        standby = v.ok && v.u.b;
+        kom_toml_string(serve, "restart", policy, sizeof(policy));
+        always = strcmp(policy, "always") == 0;
+    }
+    if (conf)
+        toml_free(conf);
+
+    if (found != 0) {
+        printf_color(COL_RED, "serve: no samp03svr/omp-server found, run \"gamemode\" first or set [serve] dir/binary");
+        return 1;
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    struct epoll_event ev = { .events = EPOLLIN };
+    ev.data.fd = sfd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &ev);
+    ev.data.fd = tfd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &ev);
+
+    memset(&spare, 0, sizeof(spare));
+    spare.pidfd = spare.out = spare.gate = -1;
+
+    st.since = time(NULL);
+    if (serve_spawn(&srv, &cur, 0, &oldmask) != 0) {
+        perror("[err]: serve");
+        goto out;
+    }
+    serve_watch(ep, &cur);
+    printf_color(COL_GREEN, "serve: %s/%s started (pid %d)%s", srv.dir, srv.binary,
+                 (int)cur.pid, standby ? ", warm standby on" : "");
+
+    if (standby && serve_spawn_standby(ep, &srv, &spare, &oldmask) != 0)
+        standby = 0;
+
+    while (!stopping || cur.pid > 0) {
+        struct epoll_event events[8];
+        /* no pidfd (old kernel): fall back to a 1s reap poll */
+        int n = epoll_wait(ep, events, 8, cur.pidfd < 0 && cur.pid > 0 ? 1000 : -1);
+        if (n < 0 && errno != EINTR)
+            break;
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == sfd) {
+                struct signalfd_siginfo si;
+                while (read(sfd, &si, sizeof(si)) == sizeof(si)) {}
+                if (!stopping) {
+                    stopping = 1;
+                    println("serve: stopping...");
+                    if (cur.pid > 0)
+                        kill(cur.pid, SIGTERM);
+                    serve_arm(tfd, SERVE_STOP_GRACE);
+                }
+            } else if (fd == tfd) {
+                uint64_t ticks;
+                if (read(tfd, &ticks, sizeof(ticks)) < 0) {}
+                if (stopping) {
+                    if (cur.pid > 0)
+                        kill(cur.pid, SIGKILL);
+                    continue;
+                }
+                if (cur.pid > 0)
+                    continue;
+                /* restart: release the standby, or spawn cold */
+                if (spare.pid > 0) {
+                    char go = 1;
+                    cur = spare;
+                    memset(&spare, 0, sizeof(spare));
+                    spare.pidfd = spare.out = spare.gate = -1;
+                    if (write(cur.gate, &go, 1) != 1) {}
+                    close(cur.gate);
+                    cur.gate = -1;
+                    cur.started_ns = serve_now_ns();
+                    serve_watch(ep, &cur);
+                } else if (serve_spawn(&srv, &cur, 0, &oldmask) == 0) {
+                    serve_watch(ep, &cur);
+                } else {
+                    perror("[err]: serve");
+                    serve_arm(tfd, SERVE_BACKOFF_MAX);
+                    continue;
+                }
+                st.restarts++;
+                printf_color(COL_YELLOW, "serve: restarted (pid %d, restart #%d)", (int)cur.pid, st.restarts);
+                serve_stats_write(&st);
+                if (standby && spare.pid <= 0 && serve_spawn_standby(ep, &srv, &spare, &oldmask) != 0)
+                    standby = 0;
+            } else if (fd == cur.out) {
+                serve_drain(ep, &cur, &srv, &st);
+            }
+        }
+
+        /* reap whatever exited, pidfd readiness or the 1s fallback brought us here */
+        int status;
+        if (spare.pid > 0 && serve_reap(&spare, &status)) {
+            if (spare.pidfd >= 0)
+                epoll_ctl(ep, EPOLL_CTL_DEL, spare.pidfd, NULL);
+            serve_close(&spare);
+            /* a standby that dies on its own is not worth a respawn loop */
+            standby = 0;
+            printf_color(COL_YELLOW, "serve: warm standby exited, continuing without it");
+        }
+        if (cur.pid > 0 && serve_reap(&cur, &status)) {
+            double up = (double)(serve_now_ns() - cur.started_ns) / 1e9;
+            int crashed = WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+
+            serve_drain(ep, &cur, &srv, &st);
+            if (cur.out >= 0)
+                epoll_ctl(ep, EPOLL_CTL_DEL, cur.out, NULL);
+            if (cur.pidfd >= 0)
+                epoll_ctl(ep, EPOLL_CTL_DEL, cur.pidfd, NULL);
+            serve_close(&cur);
+
+            st.last_uptime = up;
+            st.uptime_total += up;
+            st.crashes += crashed && !stopping;
+            serve_stats_write(&st);
+
+            if (WIFSIGNALED(status))
+                printf_color(stopping ? COL_DEFAULT : COL_RED, "serve: server killed by signal %d after %.1fs",
+                             WTERMSIG(status), up);
+            else
+                printf_color(crashed && !stopping ? COL_RED : COL_DEFAULT, "serve: server exited with %d after %.1fs",
+                             WEXITSTATUS(status), up);
+
+            if (stopping || (!crashed && !always))
+                break;
+
+            /* first crash after a stable run restarts at once, then 1, 2, 4... */
+            if (up >= SERVE_STABLE)
+                backoff = 0;
+            double delay = backoff ? backoff : 0;
+            backoff = backoff ? (backoff * 2 > SERVE_BACKOFF_MAX ? SERVE_BACKOFF_MAX : backoff * 2) : 1;
+            if (delay > 0)
+                println("serve: restarting in %.0fs", delay);
+            serve_arm(tfd, delay);
+        }
+    }
+
+out:
+    if (spare.pid > 0) {
+        close(spare.gate);      /* standby exits on EOF */
+        spare.gate = -1;
+        waitpid(spare.pid, NULL, 0);
+    }
+    serve_close(&spare);
+    if (cur.pid > 0) {
+        kill(cur.pid, SIGKILL);
+        waitpid(cur.pid, NULL, 0);
+        serve_close(&cur);
+    }
+
+    println("serve: uptime %.1fs, %d restarts, %d crashes, last ready %.0f ms",
+            st.uptime_total, st.restarts, st.crashes, st.last_ready_ms);
+
+    close(tfd);
+    close(sfd);
+    close(ep);
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    return 0;
+}
@@ -0,0 +1,27 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/serve.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "tomlc99/toml.h"
+
+#define KOM_SERVE_STATS ".komodo/serve.stats"
+
+struct kom_server {
+    char dir[512];          /* working directory of the server */
+    char binary[128];       /* executable name inside dir */
+    char ready[128];        /* console text that marks the server as up */
+};
+
+int kom_server_locate(struct kom_server *srv, toml_table_t *serve);
+int call_serve(void);
+
+#endif
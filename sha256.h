@@ -0,0 +1,31 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/sha256.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KOM_SHA256_HEX 65   /* 64 hex digits + NUL */
+
+struct kom_sha256 {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[64];
+    size_t used;
+};
+
+void kom_sha256_init(struct kom_sha256 *ctx);
+void kom_sha256_update(struct kom_sha256 *ctx, const void *data, size_t len);
+void kom_sha256_final(struct kom_sha256 *ctx, char hex[KOM_SHA256_HEX]);
+int kom_sha256_file(const char *path, char hex[KOM_SHA256_HEX]);
+
+#endif
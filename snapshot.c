@@ -0,0 +1,760 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/snapshot.c
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glob.h>
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include "color.h"
+#include "utils.h"
+#include "progress.h"
+#include "sha256.h"
+#include "serve.h"
+#include "fleet.h"
+#include "snapshot.h"
+
+/*
+ * `snapshot` / `restore`: incremental backups of server workspaces.
+ *
+ * A snapshot is KOM_SNAPSHOT_DIR/<id>.manifest, one line per file:
+ *
+ *   <sha256> <size> <mtime ns> <archive id> <path>
+ *
+ * plus <id>.tar.zst holding only the files whose content is not already
+ * in an earlier archive. Files whose size and mtime match the previous
+ * manifest are not even read; the others are hashed on a thread pool
+ * and archived only when the hash differs. Archives are written with
+ * libarchive's zstd filter using all cores, streaming each file in
+ * SNAP_CHUNK pieces. `restore` extracts every archive a manifest refers
+ * to in parallel (kom_extract_parallel) and checks each file's hash
+ * before it replaces the file on disk.
+ */
+
+#define SNAP_CHUNK      (256 * 1024)
+#define SNAP_THREADS    8
+#define SNAP_ID         32
+
+struct snap_entry {
+    char *path;
+    long long size;
+    long long mtime;            /* nanoseconds */
+    char sha[KOM_SHA256_HEX];
+    char archive[SNAP_ID];      /* snapshot id whose archive holds the content */
+    int hash;                   /* fast path missed: needs hashing */
+};
+
+struct snap_list {
+    struct snap_entry *v;
+    int n, cap;
+};
+
+struct snap_hash_pool {
+    struct snap_entry *v;
+    int n;
+    _Atomic int next;
+};
+
+struct snap_restore {
+    struct snap_entry *v;       /* the entries stored in this archive, by path */
+    int n;
+    int *found;
+    int mismatches;
+    int restored;
+};
+
+static int entry_cmp(const void *a, const void *b) {
+    return strcmp(((const struct snap_entry *)a)->path, ((const struct snap_entry *)b)->path);
+}
+
+static int entry_archive_cmp(const void *a, const void *b) {
+    const struct snap_entry *x = a, *y = b;
+    int c = strcmp(x->archive, y->archive);
+    return c ? c : strcmp(x->path, y->path);
+}
+
+static struct snap_entry *list_find(struct snap_list *l, const char *path) {
+    struct snap_entry key = { .path = (char *)path };
+    return bsearch(&key, l->v, (size_t)l->n, sizeof(key), entry_cmp);
+}
+
+static struct snap_entry *list_add(struct snap_list *l, const char *path) {
+    if (l->n == l->cap) {
+        int cap = l->cap ? l->cap * 2 : 256;
+        struct snap_entry *v = realloc(l->v, (size_t)cap * sizeof(*v));
+        if (v == NULL)
+            return NULL;
+        l->v = v;
+        l->cap = cap;
+    }
+    struct snap_entry *e = &l->v[l->n++];
+    memset(e, 0, sizeof(*e));
+    e->path = strdup(path);
+    return e;
+}
+
+static void list_free(struct snap_list *l) {
+    for (int i = 0; i < l->n; i++)
+        free(l->v[i].path);
+    free(l->v);
+    memset(l, 0, sizeof(*l));
+}
+
+/* ---- manifests ---- */
+
+static int manifest_load(struct snap_list *l, const char *id) {
+    char path[PATH_MAX], line[PATH_MAX + 256];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), KOM_SNAPSHOT_DIR "/%s.manifest", id);
+    if ((fp = fopen(path, "r")) == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        char sha[KOM_SHA256_HEX], archive[SNAP_ID];
+        long long size, mtime;
+        int at = 0;
+
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "%64s %lld %lld %31s %n", sha, &size, &mtime, archive, &at) != 4 || at == 0)
+            continue;
+        struct snap_entry *e = list_add(l, line + at);
+        if (e == NULL)
+            break;
+        e->size = size;
+        e->mtime = mtime;
+        snprintf(e->sha, sizeof(e->sha), "%s", sha);
+        snprintf(e->archive, sizeof(e->archive), "%s", archive);
+    }
+    fclose(fp);
+    qsort(l->v, (size_t)l->n, sizeof(*l->v), entry_cmp);
+    return 0;
+}
+
+static int manifest_save(const struct snap_list *l, const char *id) {
+    char path[PATH_MAX], tmp[PATH_MAX + 4];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), KOM_SNAPSHOT_DIR "/%s.manifest", id);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ((fp = fopen(tmp, "w")) == NULL)
+        return -1;
+    for (int i = 0; i < l->n; i++) {
+        const struct snap_entry *e = &l->v[i];
+        fprintf(fp, "%s %lld %lld %s %s\n", e->sha, e->size, e->mtime, e->archive, e->path);
+    }
+    if (fclose(fp) != 0)
+        return -1;
+    return rename(tmp, path);
+}
+
+/* Newest snapshot id (ids sort by time), 0 when there is none */
+static int manifest_latest(char *id, size_t len) {
+    struct dirent *ent;
+    DIR *d = opendir(KOM_SNAPSHOT_DIR);
+
+    id[0] = '\0';
+    if (d == NULL)
+        return 0;
+    while ((ent = readdir(d)) != NULL) {
+        char name[SNAP_ID];
+        char *dot = strstr(ent->d_name, ".manifest");
+        if (dot == NULL || dot[9] != '\0' || (size_t)(dot - ent->d_name) >= sizeof(name))
+            continue;
+        snprintf(name, sizeof(name), "%.*s", (int)(dot - ent->d_name), ent->d_name);
+        if (strcmp(name, id) > 0)
+            snprintf(id, len, "%s", name);
+    }
+    closedir(d);
+    return id[0] != '\0';
+}
+
+/* ---- collecting files ---- */
+
+/*
+ * Symlinks are skipped, matched by a pattern or not: fleet instances link
+ * most of the tree (databases included) to the server, which is already
+ * backed up, and restore would turn each link into a separate copy.
+ */
+static void snap_walk(struct snap_list *l, const char *path) {
+    struct stat st;
+    const char *p = path;
+
+    while (p[0] == '.' && p[1] == '/')
+        p += 2;
+    if (lstat(p, &st) != 0)
+        return;
+
+    if (S_ISREG(st.st_mode)) {
+        struct snap_entry *e = list_add(l, p);
+        if (e) {
+            e->size = (long long)st.st_size;
+            e->mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        }
+    } else if (S_ISDIR(st.st_mode)) {
+        DIR *d = opendir(p);
+        struct dirent *ent;
+        char child[PATH_MAX];
+        if (d == NULL)
+            return;
+        while ((ent = readdir(d)) != NULL) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+                continue;
+            snprintf(child, sizeof(child), "%s/%s", p, ent->d_name);
+            snap_walk(l, child);
+        }
+        closedir(d);
+    }
+}
+
+/*
+ * Manifest paths are relative to the project root, so restore can never
+ * write outside dest: an absolute match, or one climbing out with "..",
+ * is resolved and kept only when it lands inside the project.
+ */
+static void snap_glob(struct snap_list *l, const char *pattern) {
+    char cwd[PATH_MAX], real[PATH_MAX];
+    struct stat st;
+    glob_t g;
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL || glob(pattern, 0, NULL, &g) != 0)
+        return;
+    size_t n = strlen(cwd);
+    for (size_t i = 0; i < g.gl_pathc; i++) {
+        const char *p = g.gl_pathv[i];
+        if (kom_path_escapes(p)) {
+            if (lstat(p, &st) == 0 && S_ISLNK(st.st_mode))
+                continue;
+            if (realpath(p, real) == NULL || strncmp(real, cwd, n) != 0 || real[n] != '/') {
+                printf_color(COL_YELLOW, "snapshot: %s is outside the project, skipped", p);
+                continue;
+            }
+            p = real + n + 1;
+        }
+        snap_walk(l, p);
+    }
+    globfree(&g);
+}
+
+/*
+ * [snapshot] paths (glob patterns), else scriptfiles, configs and SQLite
+ * databases of the server and of every fleet instance. A database is
+ * taken with its -wal file: committed transactions may still live only
+ * there, and SQLite replays them when the restored copy opens. Rollback
+ * journals are left out, since they hold the original pages of a write
+ * in progress and, copied at another moment than the database, would
+ * roll the restored copy back into a corrupt state.
+ */
+static void snap_collect(struct snap_list *l, toml_table_t *conf) {
+    static const char *defaults[] = {
+        "scriptfiles", "server.cfg", "config.json",
+        "*.db", "*.db-wal", "*.sqlite", "*.sqlite-wal", NULL
+    };
+    toml_table_t *tab = conf ? toml_table_in(conf, "snapshot") : NULL;
+    toml_array_t *paths = tab ? toml_array_in(tab, "paths") : NULL;
+    char pattern[PATH_MAX], dir[PATH_MAX];
+    struct stat st;
+
+    if (paths) {
+        for (int i = 0; i < toml_array_nelem(paths); i++) {
+            toml_datum_t v = toml_string_at(paths, i);
+            if (v.ok) {
+                snap_glob(l, v.u.s);
+                free(v.u.s);
+            }
+        }
+    } else {
+        struct kom_server srv;
+        toml_table_t *serve = conf ? toml_table_in(conf, "serve") : NULL;
+        const char *root = kom_server_locate(&srv, serve) == 0 ? srv.dir : ".";
+
+        for (int w = -1;; w++) {
+            if (w < 0)
+                snprintf(dir, sizeof(dir), "%s", root);
+            else
+                snprintf(dir, sizeof(dir), KOM_FLEET_DIR "/instance-%d", w);
+            if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+                break;
+            for (int i = 0; defaults[i]; i++) {
+                if (snprintf(pattern, sizeof(pattern), "%s/%s", dir, defaults[i]) < (int)sizeof(pattern))
+                    snap_glob(l, pattern);
+            }
+        }
+    }
+
+    /* overlapping patterns: keep one entry per path */
+    qsort(l->v, (size_t)l->n, sizeof(*l->v), entry_cmp);
+    int out = 0;
+    for (int i = 0; i < l->n; i++) {
+        if (out > 0 && strcmp(l->v[out - 1].path, l->v[i].path) == 0) {
+            free(l->v[i].path);
+            continue;
+        }
+        l->v[out++] = l->v[i];
+    }
+    l->n = out;
+}
+
+/* ---- hashing ---- */
+
+static void *snap_hash_worker(void *arg) {
+    struct snap_hash_pool *pool = arg;
+    int i;
+
+    while ((i = atomic_fetch_add(&pool->next, 1)) < pool->n) {
+        struct snap_entry *e = &pool->v[i];
+        if (e->hash && kom_sha256_file(e->path, e->sha) != 0)
+            e->sha[0] = '\0';
+    }
+    return NULL;
+}
+
+static void snap_hash(struct snap_list *l) {
+    struct snap_hash_pool pool = { l->v, l->n, 0 };
+    pthread_t tids[SNAP_THREADS];
+    int nthreads = 0;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < ncpu && i < SNAP_THREADS; i++) {
+        if (pthread_create(&tids[nthreads], NULL, snap_hash_worker, &pool) == 0)
+            nthreads++;
+    }
+    snap_hash_worker(&pool);
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(tids[i], NULL);
+}
+
+/* ---- archive ---- */
+
+/*
+ * Stream e into the archive in chunks, rehashing what is actually stored.
+ * A file deleted since it was hashed returns 1 before anything is written.
+ * The header already promised e->size bytes, so a file that shrinks or
+ * fails to read meanwhile fails the entry (-2, reported here) rather than
+ * being padded with data it never held.
+ */
+static int snap_write_entry(struct archive *a, struct archive_entry *ae, struct snap_entry *e,
+                            unsigned char *buf, int prog)
+{
+    struct kom_sha256 ctx;
+    struct stat st;
+    long long left = e->size;
+    int fd = open(e->path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0 && errno == ENOENT)
+        return 1;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    archive_entry_clear(ae);
+    archive_entry_set_pathname(ae, e->path);
+    archive_entry_set_filetype(ae, AE_IFREG);
+    archive_entry_set_perm(ae, st.st_mode & 07777);
+    archive_entry_set_size(ae, e->size);
+    archive_entry_set_mtime(ae, (time_t)(e->mtime / 1000000000LL), (long)(e->mtime % 1000000000LL));
+    if (archive_write_header(a, ae) != ARCHIVE_OK) {
+        close(fd);
+        return -1;
+    }
+
+    kom_sha256_init(&ctx);
+    while (left > 0) {
+        size_t want = left < SNAP_CHUNK ? (size_t)left : SNAP_CHUNK;
+        ssize_t n = read(fd, buf, want);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            if (n == 0)
+                printf_color(COL_RED, "snapshot: %s shrank while being archived, run snapshot again", e->path);
+            else
+                printf_color(COL_RED, "snapshot: %s: %s", e->path, strerror(errno));
+            close(fd);
+            return -2;
+        }
+        kom_sha256_update(&ctx, buf, (size_t)n);
+        if (archive_write_data(a, buf, (size_t)n) != n) {
+            close(fd);
+            return -1;
+        }
+        left -= n;
+        kom_progress_advance(prog, n);
+    }
+    close(fd);
+    kom_sha256_final(&ctx, e->sha);
+    return 0;
+}
+
+static int snap_write_archive(struct snap_list *l, const char *id, int level, long long bytes) {
+    char path[PATH_MAX], tmp[PATH_MAX + 4], opt[16];
+    struct archive *a = archive_write_new();
+    struct archive_entry *ae = archive_entry_new();
+    unsigned char *buf = malloc(SNAP_CHUNK);
+    int failed = 0;
+
+    snprintf(path, sizeof(path), KOM_SNAPSHOT_DIR "/%s.tar.zst", id);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    archive_write_set_format_pax_restricted(a);
+    archive_write_add_filter_zstd(a);
+    snprintf(opt, sizeof(opt), "%d", level);
+    archive_write_set_filter_option(a, "zstd", "compression-level", opt);
+    /* libarchive >= 3.6.0; older versions compress on one thread */
+    snprintf(opt, sizeof(opt), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+    archive_write_set_filter_option(a, "zstd", "threads", opt);
+
+    if (buf == NULL || archive_write_open_filename(a, tmp) != ARCHIVE_OK) {
+        printf_color(COL_RED, "snapshot: %s: %s", tmp, archive_error_string(a));
+        archive_write_free(a);
+        archive_entry_free(ae);
+        free(buf);
+        return -1;
+    }
+
+    int prog = kom_progress_add(id, bytes);
+    for (int i = 0; i < l->n && !failed; i++) {
+        struct snap_entry *e = &l->v[i];
+        if (strcmp(e->archive, id) != 0)
+            continue;
+        int rc = snap_write_entry(a, ae, e, buf, prog);
+        if (rc == 1) {
+            /* gone since it was hashed: call_snapshot drops it from the manifest */
+            printf_color(COL_YELLOW, "snapshot: %s vanished, skipped", e->path);
+            e->archive[0] = '\0';
+            kom_progress_advance(prog, e->size);
+            continue;
+        }
+        if (rc == -1)
+            printf_color(COL_RED, "snapshot: %s: %s", e->path,
+                         archive_errno(a) ? archive_error_string(a) : strerror(errno));
+        failed = rc != 0;
+    }
+    kom_progress_done(prog);
+    kom_progress_wait();
+
+    if (archive_write_close(a) != ARCHIVE_OK)
+        failed = 1;
+    archive_write_free(a);
+    archive_entry_free(ae);
+    free(buf);
+
+    if (failed || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * snapshot [full]: full stores every file again instead of referring to
+ * earlier archives, so older snapshots can be deleted afterwards.
+ */
+int call_snapshot(const char *args) {
+    struct snap_list cur = { 0 }, prev = { 0 };
+    char id[SNAP_ID], last[SNAP_ID], path[PATH_MAX];
+    int full = args && strstr(args, "full") != NULL;
+    int level = 3, changed = 0, hashed = 0, ret = 0;
+    long long bytes = 0;
+    struct timespec t0, t1;
+    time_t now = time(NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    toml_table_t *conf = kom_toml_load();
+    toml_table_t *tab = conf ? toml_table_in(conf, "snapshot") : NULL;
+    toml_datum_t v = tab ? toml_int_in(tab, "level") : (toml_datum_t){ 0 };
+    if (v.ok)
+        level = (int)v.u.i;
+    snap_collect(&cur, conf);
+    if (conf)
+        toml_free(conf);
+
+    if (cur.n == 0) {
+        println("snapshot: nothing to back up");
+        return 1;
+    }
+    kom_mkdir_p(KOM_SNAPSHOT_DIR);
+    strftime(id, sizeof(id), "%Y%m%d-%H%M%S", localtime(&now));
+    if (manifest_latest(last, sizeof(last)) && !full)
+        manifest_load(&prev, last);
+    if (strcmp(id, last) == 0) {
+        printf_color(COL_RED, "snapshot: %s already exists, try again in a second", id);
+        list_free(&cur);
+        list_free(&prev);
+        return 1;
+    }
+
+    /* size + mtime unchanged: trust the previous hash */
+    for (int i = 0; i < cur.n; i++) {
+        struct snap_entry *e = &cur.v[i], *p = list_find(&prev, e->path);
+        if (p && p->size == e->size && p->mtime == e->mtime) {
+            snprintf(e->sha, sizeof(e->sha), "%s", p->sha);
+            snprintf(e->archive, sizeof(e->archive), "%s", p->archive);
+        } else {
+            e->hash = 1;
+            hashed++;
+        }
+    }
+    snap_hash(&cur);
+
+    int kept = 0;
+    for (int i = 0; i < cur.n; i++) {
+        struct snap_entry *e = &cur.v[i];
+        if (e->hash && e->sha[0] == '\0') {
+            printf_color(COL_YELLOW, "snapshot: cannot read %s, skipped", e->path);
+            free(e->path);
+            continue;
+        }
+        cur.v[kept++] = *e;
+    }
+    cur.n = kept;
+
+    for (int i = 0; i < cur.n; i++) {
+        struct snap_entry *e = &cur.v[i];
+        if (!e->hash)
+            continue;
+        struct snap_entry *p = list_find(&prev, e->path);
+        if (p && strcmp(p->sha, e->sha) == 0) {
+            snprintf(e->archive, sizeof(e->archive), "%s", p->archive);
+            continue;
+        }
+        snprintf(e->archive, sizeof(e->archive), "%s", id);
+        bytes += e->size;
+        changed++;
+    }
+
+    if (changed > 0 && snap_write_archive(&cur, id, level, bytes) != 0) {
+        ret = 1;
+    } else {
+        /* files that vanished while archiving have no archive to point at */
+        kept = 0;
+        for (int i = 0; i < cur.n; i++) {
+            struct snap_entry *e = &cur.v[i];
+            if (e->archive[0] == '\0') {
+                bytes -= e->size;
+                changed--;
+                free(e->path);
+                continue;
+            }
+            cur.v[kept++] = *e;
+        }
+        cur.n = kept;
+    }
+    if (ret == 0 && manifest_save(&cur, id) != 0) {
+        printf_color(COL_RED, "snapshot: cannot write the manifest for %s", id);
+        ret = 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (ret == 0) {
+        struct stat st;
+        snprintf(path, sizeof(path), KOM_SNAPSHOT_DIR "/%s.tar.zst", id);
+        printf_color(COL_GREEN, "snapshot: %s  %d files, %d hashed, %d stored (%.1f MiB -> %.1f MiB) in %.0f ms",
+                     id, cur.n, hashed, changed, bytes / 1048576.0,
+                     changed && stat(path, &st) == 0 ? st.st_size / 1048576.0 : 0.0,
+                     (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    }
+    list_free(&cur);
+    list_free(&prev);
+    return ret;
+}
+
+/* ---- restore ---- */
+
+/*
+ * kom_extract_parallel callback: the entries of one archive, hash-checked.
+ * Each file is written to <path>.komodo-tmp and renamed over <path> only
+ * once its hash matches, so a bad archive never clobbers the original.
+ */
+static int snap_extract(const char *path, const char *dest, void *arg) {
+    struct snap_restore *r = arg;
+    struct archive *a = archive_read_new();
+    struct archive *disk = archive_write_disk_new();
+    struct archive_entry *ae;
+    struct stat st;
+    int failed = 0, rc;
+
+    archive_read_support_format_all(a);
+    archive_read_support_filter_all(a);
+    archive_write_disk_set_options(disk, ARCHIVE_EXTRACT_TIME | ARCHIVE_EXTRACT_PERM |
+                                         ARCHIVE_EXTRACT_SECURE_NODOTDOT |
+                                         ARCHIVE_EXTRACT_SECURE_SYMLINKS);
+    if (archive_read_open_filename(a, path, SNAP_CHUNK) != ARCHIVE_OK) {
+        printf_color(COL_RED, "restore: %s: %s", path, archive_error_string(a));
+        archive_read_free(a);
+        archive_write_free(disk);
+        return 1;
+    }
+    int prog = kom_progress_add(path, stat(path, &st) == 0 ? st.st_size : 0);
+
+    while ((rc = archive_read_next_header(a, &ae)) == ARCHIVE_OK) {
+        struct snap_entry key = { .path = (char *)archive_entry_pathname(ae) };
+        struct snap_entry *e = bsearch(&key, r->v, (size_t)r->n, sizeof(key), entry_cmp);
+        if (e == NULL) {
+            archive_read_data_skip(a);
+            continue;
+        }
+        r->found[e - r->v] = 1;
+        if (kom_path_escapes(e->path)) {
+            printf_color(COL_RED, "restore: %s is outside the project, skipped", e->path);
+            archive_read_data_skip(a);
+            failed = 1;
+            continue;
+        }
+
+        char full[PATH_MAX], tmp[PATH_MAX + 16], hex[KOM_SHA256_HEX];
+        if (snprintf(full, sizeof(full), "%s/%s", dest, e->path) >= (int)sizeof(full)) {
+            printf_color(COL_RED, "restore: %s/%s: path too long", dest, e->path);
+            failed = 1;
+            continue;
+        }
+        snprintf(tmp, sizeof(tmp), "%s.komodo-tmp", full);
+        archive_entry_set_pathname(ae, tmp);
+        if (archive_write_header(disk, ae) != ARCHIVE_OK) {
+            printf_color(COL_RED, "restore: %s: %s", full, archive_error_string(disk));
+            failed = 1;
+            continue;
+        }
+
+        struct kom_sha256 ctx;
+        const void *block;
+        size_t size;
+        la_int64_t offset;
+        int written = 1;
+        kom_sha256_init(&ctx);
+        while ((rc = archive_read_data_block(a, &block, &size, &offset)) == ARCHIVE_OK) {
+            kom_sha256_update(&ctx, block, size);
+            if (archive_write_data_block(disk, block, size, offset) != ARCHIVE_OK) {
+                written = 0;
+                break;
+            }
+        }
+        if (rc != ARCHIVE_EOF || archive_write_finish_entry(disk) != ARCHIVE_OK)
+            written = 0;
+        kom_sha256_final(&ctx, hex);
+
+        if (!written) {
+            printf_color(COL_RED, "restore: %s: %s", e->path,
+                         archive_errno(disk) ? archive_error_string(disk) : archive_error_string(a));
+            unlink(tmp);
+            failed = 1;
+        } else if (strcmp(hex, e->sha) != 0) {
+            printf_color(COL_RED, "restore: %s: hash mismatch, left untouched", e->path);
+            unlink(tmp);
+            r->mismatches++;
+            failed = 1;
+        } else if (rename(tmp, full) != 0) {
+            printf_color(COL_RED, "restore: %s: %s", full, strerror(errno));
+            unlink(tmp);
+            failed = 1;
+        } else {
+            r->restored++;
+        }
+        kom_progress_update(prog, archive_filter_bytes(a, -1), 0);
+    }
+    if (rc != ARCHIVE_EOF) {
+        printf_color(COL_RED, "restore: %s: %s", path, archive_error_string(a));
+        failed = 1;
+    }
+    kom_progress_done(prog);
+
+    for (int i = 0; i < r->n; i++) {
+        if (!r->found[i]) {
+            printf_color(COL_RED, "restore: %s missing from %s", r->v[i].path, path);
+            failed = 1;
+        }
+    }
+    archive_read_close(a);
+    archive_read_free(a);
+    archive_write_close(disk);
+    archive_write_free(disk);
+    return failed;
+}
+
+/* restore [id] [dest]: the newest snapshot into the project by default */
+int call_restore(const char *args) {
+    struct snap_list l = { 0 };
+    char buf[PATH_MAX], id[SNAP_ID] = "", dest[PATH_MAX] = ".";
+    int njobs = 0, restored = 0, mismatches = 0;
+
+    snprintf(buf, sizeof(buf), "%s", args ? args : "");
+    char *tok = strtok(buf, " ");
+    if (tok) {
+        snprintf(id, sizeof(id), "%s", tok);
+        if ((tok = strtok(NULL, " ")) != NULL)
+            snprintf(dest, sizeof(dest), "%s", tok);
+    }
+    if (id[0] == '\0' && !manifest_latest(id, sizeof(id))) {
+        printf_color(COL_RED, "restore: no snapshots in " KOM_SNAPSHOT_DIR);
+        return 1;
+    }
+    if (manifest_load(&l, id) != 0) {
+        printf_color(COL_RED, "restore: snapshot %s not found", id);
+        return 1;
+    }
+
+    /* one job per archive, each with its entries sorted by path */
+    qsort(l.v, (size_t)l.n, sizeof(*l.v), entry_archive_cmp);
+    struct kom_extract_job *jobs = calloc((size_t)l.n + 1, sizeof(*jobs));
+    struct snap_restore *ctx = calloc((size_t)l.n + 1, sizeof(*ctx));
+    char (*paths)[PATH_MAX] = calloc((size_t)l.n + 1, PATH_MAX);
+    int *found = calloc((size_t)l.n + 1, sizeof(int));
+    if (jobs == NULL || ctx == NULL || paths == NULL || found == NULL) {
+        free(jobs); free(ctx); free(paths); free(found);
+        list_free(&l);
+        return 1;
+    }
+
+    for (int i = 0; i < l.n;) {
+        int j = i;
+        while (j < l.n && strcmp(l.v[j].archive, l.v[i].archive) == 0)
+            j++;
+        ctx[njobs].v = &l.v[i];
+        ctx[njobs].n = j - i;
+        ctx[njobs].found = &found[i];
+        snprintf(paths[njobs], PATH_MAX, KOM_SNAPSHOT_DIR "/%s.tar.zst", l.v[i].archive);
+        jobs[njobs].path = paths[njobs];
+        jobs[njobs].dest = dest;
+        jobs[njobs].extract = snap_extract;
+        jobs[njobs].ctx = &ctx[njobs];
+        njobs++;
+        i = j;
+    }
+
+    int failed = kom_extract_parallel(jobs, njobs);
+    kom_progress_wait();
+    for (int i = 0; i < njobs; i++) {
+        restored += ctx[i].restored;
+        mismatches += ctx[i].mismatches;
+    }
+    printf_color(failed ? COL_RED : COL_GREEN, "restore: %s  %d/%d files from %d archive(s) into %s, %d hash mismatches",
+                 id, restored, l.n, njobs, dest, mismatches);
+
+    free(jobs);
+    free(ctx);
+    free(paths);
+    free(found);
+    list_free(&l);
+    return failed ? 1 : 0;
+}
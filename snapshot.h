@@ -0,0 +1,19 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/snapshot.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#define KOM_SNAPSHOT_DIR    ".komodo/snapshots"
+
+int call_snapshot(const char *args);
+int call_restore(const char *args);
+
+#endif
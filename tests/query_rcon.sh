@@ -0,0 +1,87 @@
+#!/bin/sh
+#
+# Project Name: Komodo Toolchain
+# Project File: Komodo/tests/query_rcon.sh
+# Copyright (C) Komodo/Contributors
+#
+# This program is distributed under the terms of the GNU General Public License v2.0.
+# See the LICENSE file for details.
+#
+# Drive `query` and `rcon` against samp_responder.py on 127.0.0.1:
+# a dropped info request that only a retry recovers, a duplicated target,
+# a server without ping replies, an offline port, rcon replies credited
+# to the right command on a slow server and the JSON export.
+#
+#   KOMODO=/path/to/komodo tests/query_rcon.sh
+
+KOMODO=$(realpath "${KOMODO:-./komodo}")
+HERE=$(dirname "$(realpath "$0")")
+P1=17701 P2=17702 P3=17703 OFF=17709
+WORK=$(mktemp -d)
+FAILED=0
+
+trap 'kill $RESPONDER 2>/dev/null; rm -rf "$WORK"' EXIT
+
+check() {
+    if grep -q -- "$2" "$WORK/out"; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1: no \"$2\" in output"
+        FAILED=1
+    fi
+}
+
+check_absent() {
+    if grep -q -- "$2" "$WORK/out"; then
+        echo "FAIL $1: \"$2\" in output"
+        FAILED=1
+    else
+        echo "ok   $1"
+    fi
+}
+
+# fleet instances are the rcon targets when komodo.toml lists none
+for i in 0 1 2; do
+    mkdir -p "$WORK/fleet/instance-$i"
+done
+printf 'port %d\nrcon_password test\n' $P1 > "$WORK/fleet/instance-0/server.cfg"
+printf 'port %d\nrcon_password test\n' $P2 > "$WORK/fleet/instance-1/server.cfg"
+printf 'port %d\nrcon_password test\n' $OFF > "$WORK/fleet/instance-2/server.cfg"
+
+python3 "$HERE/samp_responder.py" --port $P1 --port $P2 --port $P3 \
+    --drop-info $P2:1 --no-ping $P3 --rcon-delay $P2:0.2 --password test --idle 15 &
+RESPONDER=$!
+sleep 0.5
+
+cd "$WORK" || exit 1
+printf '%s\n' \
+    "query 127.0.0.1:$P1 127.0.0.1:$P2 127.0.0.1:$P1 127.0.0.1:$P3 127.0.0.1:$OFF" \
+    "query 127.0.0.1:$P1 127.0.0.1:$OFF json $WORK/query.json" \
+    "rcon say hello" \
+    "rcon say one; say two" \
+    exit exit | "$KOMODO" 2>&1 | sed 's/\x1b\[[0-9;]*m//g' > "$WORK/out"
+
+check "retry recovers a dropped info request" "127.0.0.1:$P2 .*test server $P2"
+check "duplicate targets both answered" "4/5 servers answered"
+check "missing ping prints -" "127.0.0.1:$P3 .* - "
+check "offline target in the table" "127.0.0.1:$OFF *offline"
+check "rcon reply" "\[say hello\] ran say hello"
+check "rcon offline target" "127.0.0.1:$OFF: no reply"
+check "rcon summary" "to 3 server(s), 2 replied"
+check "next command waits for the slow reply" "\[say two\] ran say two"
+check_absent "slow rcon reply credited to its command" "\[say two\] ran say one"
+
+if python3 -c '
+import json, sys
+r = json.load(open(sys.argv[1]))
+assert [s["online"] for s in r] == [True, False]
+assert r[0]["clients"][0]["score"] == 42 and "ping_ms" not in r[1]
+' "$WORK/query.json"; then
+    echo "ok   json export"
+else
+    echo "FAIL json export"
+    FAILED=1
+fi
+
+[ $FAILED -eq 0 ] || cat "$WORK/out"
+exit $FAILED
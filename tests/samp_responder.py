@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+#
+# Project Name: Komodo Toolchain
+# Project File: Komodo/tests/samp_responder.py
+# Copyright (C) Komodo/Contributors
+#
+# This program is distributed under the terms of the GNU General Public License v2.0.
+# See the LICENSE file for details.
+#
+# Local SA-MP query/RCON responder for exercising `query` and `rcon`
+# without real servers. Every --port answers the i, r, c, p and x opcodes
+# on 127.0.0.1; the server exits after --idle seconds without a packet.
+#
+#   --drop-info PORT:N   ignore the first N info requests on PORT (retries)
+#   --no-ping PORT       never answer 'p' on PORT (table shows "-")
+#   --password PW        rcon password every port accepts
+#   --rcon-delay PORT:S  answer rcon on PORT S seconds late (slow server)
+
+import argparse
+import select
+import socket
+import struct
+import time
+
+
+def lstr(fmt, data):
+    return struct.pack(fmt, len(data)) + data
+
+
+def reply(port, op, body, password):
+    if op == b'i':
+        return (b'\x00' + struct.pack('<HH', 3, 50) +
+                lstr('<I', ('test server %d' % port).encode()) +
+                lstr('<I', b'freeroam') + lstr('<I', b'EN'))
+    if op == b'r':
+        return struct.pack('<H', 2) + lstr('B', b'version') + lstr('B', b'0.3.7-R2') + \
+               lstr('B', b'weather') + lstr('B', b'10')
+    if op == b'c':
+        return struct.pack('<H', 1) + lstr('B', b'Bob') + struct.pack('<i', 42)
+    if op == b'p':
+        return body[:4]
+    if op == b'x':
+        plen = struct.unpack('<H', body[:2])[0]
+        pw = body[2:2 + plen]
+        clen = struct.unpack('<H', body[2 + plen:4 + plen])[0]
+        cmd = body[4 + plen:4 + plen + clen]
+        text = b'ran ' + cmd if pw == password else b'Invalid RCON password.'
+        return lstr('<H', text)
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--port', type=int, action='append', required=True)
+    ap.add_argument('--drop-info', action='append', default=[])
+    ap.add_argument('--no-ping', type=int, action='append', default=[])
+    ap.add_argument('--password', default='test')
+    ap.add_argument('--rcon-delay', action='append', default=[])
+    ap.add_argument('--idle', type=float, default=10)
+    args = ap.parse_args()
+
+    drop = {}
+    for spec in args.drop_info:
+        port, count = spec.split(':')
+        drop[int(port)] = int(count)
+    delay = {}
+    for spec in args.rcon_delay:
+        port, secs = spec.split(':')
+        delay[int(port)] = float(secs)
+
+    socks = []
+    for port in args.port:
+        s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        s.bind(('127.0.0.1', port))
+        socks.append(s)
+
+    pending = []    # (when, sock, packet, addr) for delayed rcon replies
+    while True:
+        now = time.monotonic()
+        for item in [p for p in pending if p[0] <= now]:
+            item[1].sendto(item[2], item[3])
+            pending.remove(item)
+        timeout = min([args.idle] + [p[0] - now for p in pending])
+        ready, _, _ = select.select(socks, [], [], max(timeout, 0))
+        if not ready:
+            if pending:
+                continue
+            return
+        for s in ready:
+            data, addr = s.recvfrom(2048)
+            port = s.getsockname()[1]
+            if len(data) < 11 or data[:4] != b'SAMP':
+                continue
+            op = data[10:11]
+            if op == b'i' and drop.get(port, 0) > 0:
+                drop[port] -= 1
+                continue
+            if op == b'p' and port in args.no_ping:
+                continue
+            body = reply(port, op, data[11:], args.password.encode())
+            if body is None:
+                continue
+            if op == b'x' and port in delay:
+                pending.append((time.monotonic() + delay[port], s, data[:11] + body, addr))
+            else:
+                s.sendto(data[:11] + body, addr)
+
+
+if __name__ == '__main__':
+    main()
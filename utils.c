@@ -27,6 +27,8 @@
 #include <inttypes.h>
 #include <sys/stat.h>
 #include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <sys/types.h>
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -36,6 +38,9 @@
 #include "tomlc99/toml.h"
 
 #include "color.h"
+#include "utils.h"
+#include "progress.h"
+#include "prefetch.h"
 
 const char
     *komodo_os;
@@ -133,6 +138,54 @@ int kom_toml_data(void)
     return 0;
 }
 
+/*
+ * mkdir -p: create path and any missing parents, 0 if it ends up a directory.
+ */
+int kom_mkdir_p(const char *path) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(tmp, 0755) != 0 && errno != EEXIST)
+            return -1;
+        *p = '/';
+    }
+    if (mkdir(tmp, 0755) != 0 && errno != EEXIST)
+        return -1;
+    return 0;
+}
+
+/*
+ * Parse komodo.toml and return its root table (free with toml_free),
+ * or NULL when it is missing or malformed.
+ */
+toml_table_t *kom_toml_load(void) {
+    char errbuf[256];
+    FILE *fp = fopen("komodo.toml", "r");
+
+    if (fp == NULL)
+        return NULL;
+
+    toml_table_t *config = toml_parse_file(fp, errbuf, sizeof(errbuf));
+    fclose(fp);
+    if (!config)
+        printf("Error parsing TOML: %s\n", errbuf);
+    return config;
+}
+
+/* Copy a string key of tab into out, leaving out untouched when absent */
+int kom_toml_string(toml_table_t *tab, const char *key, char *out, size_t len) {
+    toml_datum_t v = tab ? toml_string_in(tab, key) : (toml_datum_t){ 0 };
+    if (!v.ok)
+        return 0;
+    snprintf(out, len, "%s", v.u.s);
+    free(v.u.s);
+    return 1;
+}
+
 int call_kom_undefined_sizeof(
                          const char *str1, const char *str2)
 {
@@ -190,14 +243,14 @@ void printf_color(
         * printf_color(COL_DEFAULT, "reset text!");
     */
 
+    /* one line through the progress module, so a live redraw cannot eat it */
+    char line[4096];
     va_list args;
     va_start(args, format);
-
-    printf("%s", color);
-    vprintf(format, args);
-    printf("%s\n", COL_DEFAULT);
-
+    vsnprintf(line, sizeof(line), format, args);
     va_end(args);
+
+    kom_progress_printf(stdout, "%s%s%s\n", color, line, COL_DEFAULT);
 }
 
 void println(const char* fmt, ...) {
@@ -232,7 +285,7 @@ int arch_copy_data(
         __read = archive_write_data_block(aw, __buff, size, offset);
         if (__read != ARCHIVE_OK) {
             /* Print write error and return code */
-            fprintf(stderr, "Write error: %s\n", archive_error_string(aw));
+            kom_progress_printf(stderr, "Write error: %s\n", archive_error_string(aw));
             return __read;
         }
     }
@@ -259,12 +312,18 @@ int call_extract_tar_gz(const char *fname) {
     if (__read != ARCHIVE_OK)
         return 1; /* Return error if archive can't be opened */
 
+    /* Track compressed bytes consumed against the archive size */
+    struct stat __st;
+    int __prog = kom_progress_add(fname, stat(fname, &__st) == 0 ? __st.st_size : 0);
+
     /* Loop through each __entry in the archive */
     while (archive_read_next_header(__arch, &__entry) == ARCHIVE_OK) {
         archive_write_header(__ext, __entry);
         arch_copy_data(__arch, __ext);
         archive_write_finish_entry(__ext);
+        kom_progress_update(__prog, archive_filter_bytes(__arch, -1), 0);
     }
+    kom_progress_done(__prog);
 
     /* Clean up */
     archive_read_close(__arch);
@@ -298,6 +357,9 @@ int call_extract_zip(
         return 1;
     }
 
+    struct stat __st;
+    int __prog = kom_progress_add(zip_path, stat(zip_path, &__st) == 0 ? __st.st_size : 0);
+
     /* Create and configure archive writer */
     __ext = archive_write_disk_new();
     archive_write_disk_set_options(__ext, ARCHIVE_EXTRACT_TIME);
@@ -315,7 +377,7 @@ int call_extract_zip(
         /* Write __entry header */
         __read = archive_write_header(__ext, __entry);
         if (__read != ARCHIVE_OK) {
-            fprintf(stderr, "%s\n", archive_error_string(__ext));
+            kom_progress_printf(stderr, "%s\n", archive_error_string(__ext));
         } else {
             /* Read and write file content block by block */
             const void *__buff;
@@ -327,13 +389,15 @@ int call_extract_zip(
                 if (__read == ARCHIVE_EOF)
                     break;
                 if (__read < ARCHIVE_OK)
-                    fprintf(stderr, "%s\n", archive_error_string(__arch));
+                    kom_progress_printf(stderr, "%s\n", archive_error_string(__arch));
                 __read = archive_write_data_block(__ext, __buff, size, offset);
                 if (__read < ARCHIVE_OK)
-                    fprintf(stderr, "%s\n", archive_error_string(__ext));
+                    kom_progress_printf(stderr, "%s\n", archive_error_string(__ext));
             }
         }
+        kom_progress_update(__prog, archive_filter_bytes(__arch, -1), 0);
     }
+    kom_progress_done(__prog);
 
     /* Clean up */
     archive_read_close(__arch);
@@ -344,6 +408,137 @@ int call_extract_zip(
     return 0;
 }
 
+/* Absolute, or with a ".." component that could climb out of dest */
+int kom_path_escapes(const char *path) {
+    if (path[0] == '/')
+        return 1;
+    for (const char *p = path; *p; ) {
+        size_t n = strcspn(p, "/");
+        if (n == 2 && p[0] == '.' && p[1] == '.')
+            return 1;
+        p += n;
+        while (*p == '/')
+            p++;
+    }
+    return 0;
+}
+
+/*
+ * Extract any archive libarchive understands (tar.*, zip) under dest.
+ * Entries are sanitised, since this is used on third-party archives.
+ */
+int call_extract_to(
+               const char *path, const char *__dest_path)
+{
+    struct archive
+        *__arch;
+    struct archive
+        *__ext;
+    struct archive_entry
+        *__entry;
+    int
+        __read, __failed = 0;
+
+    __arch = archive_read_new();
+    archive_read_support_format_all(__arch);
+    archive_read_support_filter_all(__arch);
+
+    if ((__read = archive_read_open_filename(__arch, path, 65536))) {
+        fprintf(stderr, "Can't open: %s\n", archive_error_string(__arch));
+        archive_read_free(__arch);
+        return 1;
+    }
+
+    struct stat __st;
+    int __prog = kom_progress_add(path, stat(path, &__st) == 0 ? __st.st_size : 0);
+
+    __ext = archive_write_disk_new();
+    archive_write_disk_set_options(__ext, ARCHIVE_EXTRACT_TIME |
+                                          ARCHIVE_EXTRACT_SECURE_NODOTDOT |
+                                          ARCHIVE_EXTRACT_SECURE_SYMLINKS);
+
+    while ((__read = archive_read_next_header(__arch, &__entry)) == ARCHIVE_OK) {
+        char __full_path[4096];
+        snprintf(__full_path, sizeof(__full_path), "%s/%s",
+                 __dest_path, archive_entry_pathname(__entry));
+        archive_entry_set_pathname(__entry, __full_path);
+
+        /* a hardlink target is a path too: keep it under dest as well */
+        const char *__link = archive_entry_hardlink(__entry);
+        if (__link != NULL) {
+            if (kom_path_escapes(__link)) {
+                kom_progress_printf(stderr, "%s: hardlink to %s is outside the archive\n",
+                                    archive_entry_pathname(__entry), __link);
+                __failed = 1;
+                continue;
+            }
+            snprintf(__full_path, sizeof(__full_path), "%s/%s", __dest_path, __link);
+            archive_entry_set_hardlink(__entry, __full_path);
+        }
+
+        if (archive_write_header(__ext, __entry) != ARCHIVE_OK) {
+            kom_progress_printf(stderr, "%s\n", archive_error_string(__ext));
+            __failed = 1;
+        } else if (arch_copy_data(__arch, __ext) != ARCHIVE_OK) {
+            __failed = 1;
+        }
+        archive_write_finish_entry(__ext);
+        kom_progress_update(__prog, archive_filter_bytes(__arch, -1), 0);
+    }
+    if (__read != ARCHIVE_EOF) {
+        kom_progress_printf(stderr, "%s: %s\n", path, archive_error_string(__arch));
+        __failed = 1;
+    }
+    kom_progress_done(__prog);
+
+    archive_read_close(__arch);
+    archive_read_free(__arch);
+    archive_write_close(__ext);
+    archive_write_free(__ext);
+
+    return __failed;
+}
+
+static void *extract_worker(void *arg) {
+    struct kom_extract_pool *pool = arg;
+    int i;
+
+    while ((i = atomic_fetch_add(&pool->next, 1)) < pool->count) {
+        struct kom_extract_job *job = &pool->jobs[i];
+        job->result = job->extract ?
+            job->extract(job->path, job->dest, job->ctx) :
+            call_extract_to(job->path, job->dest);
+    }
+    return NULL;
+}
+
+/*
+ * Run a batch of extractions on a small thread pool, one archive per
+ * worker at a time. Returns the number of jobs that failed.
+ */
+int kom_extract_parallel(struct kom_extract_job *jobs, int count) {
+    struct kom_extract_pool pool = { jobs, count, 0 };
+    pthread_t tids[KOM_EXTRACT_THREADS];
+    int nthreads = 0, failed = 0;
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int want = count < ncpu ? count : (int)ncpu;
+    if (want > KOM_EXTRACT_THREADS) want = KOM_EXTRACT_THREADS;
+
+    for (int i = 1; i < want; i++) {
+        if (pthread_create(&tids[nthreads], NULL, extract_worker, &pool) == 0)
+            nthreads++;
+    }
+    extract_worker(&pool);   /* the caller works too */
+
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(tids[i], NULL);
+
+    for (int i = 0; i < count; i++)
+        failed += jobs[i].result != 0;
+    return failed;
+}
+
 /*
  * Callback for libcurl to write downloaded data into a file.
  */
@@ -357,21 +552,60 @@ size_t write_file(void *ptr,
 }
 
 /*
- * Progress callback for libcurl to show download progress.
+ * Progress callback for libcurl, publishes the counters to the renderer.
  */
 int progress_callback(void *ptr,
-                     double dltotal,
-                     double dlnow,
-                     double ultotal, 
-                     double ulnow
+                     curl_off_t dltotal,
+                     curl_off_t dlnow,
+                     curl_off_t ultotal,
+                     curl_off_t ulnow
 ) {
-    if (dltotal > 0) {
-        printf("\rDownloading: %.0f%%", (dlnow / dltotal) * 100);
-        fflush(stdout);
-    }
+    (void)ultotal;
+    (void)ulnow;
+    kom_progress_update((int)(intptr_t)ptr, dlnow, dltotal);
     return 0;
 }
 
+static pthread_mutex_t __share_locks[CURL_LOCK_DATA_LAST];
+
+static void share_lock(CURL *handle, curl_lock_data data,
+                       curl_lock_access access, void *userptr)
+{
+    (void)handle;
+    (void)access;
+    (void)userptr;
+    pthread_mutex_lock(&__share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+    (void)handle;
+    (void)userptr;
+    pthread_mutex_unlock(&__share_locks[data]);
+}
+
+static CURLSH *__share = NULL;
+static pthread_once_t __share_once = PTHREAD_ONCE_INIT;
+
+static void share_init(void) {
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_init(&__share_locks[i], NULL);
+    __share = curl_share_init();
+    curl_share_setopt(__share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(__share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(__share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(__share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(__share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+/*
+ * Process-wide curl share: DNS cache, TLS sessions and the connection
+ * pool, so connections warmed by prefetch are reused by real downloads.
+ */
+CURLSH *kom_curl_share(void) {
+    pthread_once(&__share_once, share_init);
+    return __share;
+}
+
 void call_download_file(const char *url,
                    const char *fname
 ) {
@@ -389,14 +623,17 @@ void call_download_file(const char *url,
         return;
     }
 
-    /* Initialize libcurl globally */
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+    /* libcurl is initialised once in main, the share outlives each download */
     __curl =
         curl_easy_init();
 
     if (__curl) {
-        /* Set URL to download */
+        /* Set URL to download, reusing connections warmed by prefetch */
         curl_easy_setopt(__curl, CURLOPT_URL, url);
+        curl_easy_setopt(__curl, CURLOPT_SHARE, kom_curl_share());
+
+        curl_off_t __length = 0;
+        kom_prefetch_lookup(url, &__length);
 
         /* Set write callback and file destination */
         curl_easy_setopt(__curl, CURLOPT_WRITEFUNCTION, write_file);
@@ -405,23 +642,26 @@ void call_download_file(const char *url,
         /* Follow redirects */
         curl_easy_setopt(__curl, CURLOPT_FOLLOWLOCATION, 1L);
 
-        /* Set progress callback */
+        /* Set progress callback, counters go to the progress renderer */
+        int __prog = kom_progress_add(fname, __length > 0 ? __length : 0);
         curl_easy_setopt(__curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
+        curl_easy_setopt(__curl, CURLOPT_XFERINFODATA, (void *)(intptr_t)__prog);
         curl_easy_setopt(__curl, CURLOPT_NOPROGRESS, 0L);
 
         /* Perform the file download */
         __res = curl_easy_perform(__curl);
+        kom_progress_done(__prog);
+        kom_progress_wait();
 
         if (__res != CURLE_OK) {
             /* Print error message on failure */
             fprintf(stderr, "[err]: failed to download the file: %s\n", curl_easy_strerror(__res));
             fclose(__fp);
             curl_easy_cleanup(__curl);
-            curl_global_cleanup();
             return;
         }
 
-        printf("\nDownload completed successfully.\n");
+        printf("Download completed successfully.\n");
 
         /* Automatically extract archive if it's a tar.gz or zip file */
         if (strstr(fname, ".tar.gz")) {
@@ -440,6 +680,7 @@ void call_download_file(const char *url,
         
             call_extract_zip(fname, zip_of_pos);
         }
+        kom_progress_wait();
 
         /* Close the file and clean up curl */
         fclose(__fp);
@@ -448,7 +689,4 @@ void call_download_file(const char *url,
         /* Handle curl initialization failure */
         fprintf(stderr, "[err]: failed to initialize curl session\n");
     }
-
-    /* Global cleanup for curl */
-    curl_global_cleanup();
 }
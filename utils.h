@@ -11,15 +11,45 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdio.h>
+#include <curl/curl.h>
+
+#include "tomlc99/toml.h"
+
 int kom_toml_data(void);
-extern char *komodo_os;
+toml_table_t *kom_toml_load(void);
+int kom_toml_string(toml_table_t *tab, const char *key, char *out, size_t len);
+extern const char *komodo_os;
+int kom_mkdir_p(const char *path);
 int call_kom_undefined_sizeof(const char *str1, const char *str2);
 void printf_color(const char *color, const char *format, ...);
 void println(const char* fmt, ...);
 int call_extract_tar_gz(const char *fname);
 int call_extract_zip(const char *zip_path, const char *dest_path);
+int kom_path_escapes(const char *path);
+int call_extract_to(const char *path, const char *dest_path);
+
+#define KOM_EXTRACT_THREADS 8
+
+/* extract may be NULL for a plain call_extract_to of path into dest */
+struct kom_extract_job {
+    const char *path;
+    const char *dest;
+    int (*extract)(const char *path, const char *dest, void *ctx);
+    void *ctx;
+    int result;
+};
+
+struct kom_extract_pool {
+    struct kom_extract_job *jobs;
+    int count;
+    _Atomic int next;
+};
+
+int kom_extract_parallel(struct kom_extract_job *jobs, int count);
 size_t write_file(void *ptr, size_t size, size_t nmemb, FILE *stream);
-int progress_callback(void *ptr, double dltotal, double dlnow, double ultotal, double ulnow);
+int progress_callback(void *ptr, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+CURLSH *kom_curl_share(void);
 void call_download_file(const char *url, const char *fname);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,633 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/watch.c
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include <libgen.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+
+#include "color.h"
+#include "utils.h"
+#include "serve.h"
+#include "rcon.h"
+#include "amx.h"
+#include "watch.h"
+
+/*
+ * `watch`: edit-compile-reload loop. Every .pwn in gamemodes/ and
+ * filterscripts/ is a target; its #include closure is scanned so a change
+ * to an include only recompiles the targets that actually pull it in.
+ * inotify events are debounced (an editor save is often several writes
+ * and a rename), the affected targets go through pawncc with diagnostics
+ * streamed to the terminal, then RCON reloads the filterscript (reloadfs)
+ * or restarts the gamemode (gmx). Each cycle reports its timings.
+ */
+
+#define WATCH_DEBOUNCE_MS   250
+#define WATCH_TARGETS       64
+#define WATCH_INCDIRS       32
+#define WATCH_DIRS          256
+
+struct watch_target {
+    char path[PATH_MAX];    /* the .pwn, as found on disk */
+    char name[128];         /* basename without extension */
+    int filterscript;
+    char **deps;            /* realpaths of the #include closure */
+    int ndeps;
+    int dirty;
+};
+
+struct watch_ctx {
+    struct kom_server srv;
+    char pawncc[PATH_MAX];
+    char incdirs[WATCH_INCDIRS][PATH_MAX];
+    int nincdirs;
+    char flags[16][64];
+    int nflags;
+    struct watch_target targets[WATCH_TARGETS];
+    int ntargets;
+    int ino;
+    struct { int wd; char path[PATH_MAX]; } dirs[WATCH_DIRS];
+    int ndirs;
+};
+
+static double watch_ms(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e3 + (b->tv_nsec - a->tv_nsec) / 1e6;
+}
+
+static int is_source(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return dot && (strcmp(dot, ".pwn") == 0 || strcmp(dot, ".inc") == 0 ||
+                   strcmp(dot, ".p") == 0 || strcmp(dot, ".pawn") == 0);
+}
+
+/* ---- include closure ---- */
+
+static int deps_has(const struct watch_target *t, const char *path) {
+    for (int i = 0; i < t->ndeps; i++) {
+        if (strcmp(t->deps[i], path) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static int try_include(const char *dir, const char *name, char *out) {
+    const char *exts[] = { "", ".inc", ".p", ".pawn", ".pwn" };
+    char path[PATH_MAX];
+
+    for (int e = 0; e < 5; e++) {
+        snprintf(path, sizeof(path), "%s/%s%s", dir, name, exts[e]);
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && realpath(path, out))
+            return 1;
+    }
+    return 0;
+}
+
+static void scan_includes(struct watch_ctx *w, struct watch_target *t, const char *file) {
+    char line[1024], dir[PATH_MAX], tmp[PATH_MAX];
+    FILE *fp = fopen(file, "r");
+
+    if (fp == NULL)
+        return;
+    snprintf(tmp, sizeof(tmp), "%s", file);
+    snprintf(dir, sizeof(dir), "%s", dirname(tmp));
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = line, name[PATH_MAX], found[PATH_MAX];
+        while (isspace((unsigned char)*p)) p++;
+        if (strncmp(p, "#include", 8) == 0)
+            p += 8;
+        else if (strncmp(p, "#tryinclude", 11) == 0)
+            p += 11;
+        else
+            continue;
+        while (isspace((unsigned char)*p)) p++;
+
+        char close = *p == '<' ? '>' : *p == '"' ? '"' : 0;
+        char *end = close ? strchr(p + 1, close) : NULL;
+        if (end == NULL)
+            continue;
+        snprintf(name, sizeof(name), "%.*s", (int)(end - p - 1), p + 1);
+        for (char *c = name; *c; c++)
+            if (*c == '\\') *c = '/';
+
+        /* "file" looks next to the includer first, <file> only in -i dirs */
+        int ok = close == '"' && try_include(dir, name, found);
+        for (int i = 0; !ok && i < w->nincdirs; i++)
+            ok = try_include(w->incdirs[i], name, found);
+        if (!ok || deps_has(t, found))
+            continue;
+
+        char **deps = realloc(t->deps, sizeof(char *) * (size_t)(t->ndeps + 1));
+        if (deps == NULL)
+            break;
+        t->deps = deps;
+        t->deps[t->ndeps++] = strdup(found);
+        scan_includes(w, t, found);
+    }
+    fclose(fp);
+}
+
+static void target_rescan(struct watch_ctx *w, struct watch_target *t) {
+    char self[PATH_MAX];
+
+    for (int i = 0; i < t->ndeps; i++)
+        free(t->deps[i]);
+    free(t->deps);
+    t->deps = NULL;
+    t->ndeps = 0;
+
+    if (realpath(t->path, self)) {
+        t->deps = malloc(sizeof(char *));
+        t->deps[t->ndeps++] = strdup(self);
+    }
+    scan_includes(w, t, t->path);
+}
+
+/* ---- inotify ---- */
+
+static void watch_dir(struct watch_ctx *w, const char *path) {
+    char real[PATH_MAX];
+
+    if (w->ndirs >= WATCH_DIRS || realpath(path, real) == NULL)
+        return;
+    for (int i = 0; i < w->ndirs; i++) {
+        if (strcmp(w->dirs[i].path, real) == 0)
+            return;
+    }
+    int wd = inotify_add_watch(w->ino, real, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+    if (wd < 0)
+        return;
+    w->dirs[w->ndirs].wd = wd;
+    snprintf(w->dirs[w->ndirs].path, sizeof(w->dirs[0].path), "%s", real);
+    w->ndirs++;
+}
+
+/* Watch every directory that holds a file of some target's closure */
+static void watch_closures(struct watch_ctx *w) {
+    char tmp[PATH_MAX];
+
+    for (int t = 0; t < w->ntargets; t++) {
+        for (int d = 0; d < w->targets[t].ndeps; d++) {
+            snprintf(tmp, sizeof(tmp), "%s", w->targets[t].deps[d]);
+            watch_dir(w, dirname(tmp));
+        }
+    }
+}
+
+static int add_target(struct watch_ctx *w, const char *path, int filterscript) {
+    if (w->ntargets >= WATCH_TARGETS)
+        return -1;
+
+    struct watch_target *t = &w->targets[w->ntargets++];
+    const char *base = strrchr(path, '/');
+    memset(t, 0, sizeof(*t));
+    snprintf(t->path, sizeof(t->path), "%s", path);
+    snprintf(t->name, sizeof(t->name), "%s", base ? base + 1 : path);
+    char *dot = strrchr(t->name, '.');
+    if (dot) *dot = '\0';
+    t->filterscript = filterscript;
+    target_rescan(w, t);
+    return 0;
+}
+
+static void find_targets(struct watch_ctx *w, const char *sub, int filterscript) {
+    char dir[PATH_MAX], path[PATH_MAX];
+    struct dirent *ent;
+
+    snprintf(dir, sizeof(dir), "%s/%s", w->srv.dir, sub);
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return;
+    watch_dir(w, dir);
+    while ((ent = readdir(d)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len > 4 && strcmp(ent->d_name + len - 4, ".pwn") == 0 &&
+            snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name) < (int)sizeof(path))
+            add_target(w, path, filterscript);
+    }
+    closedir(d);
+}
+
+/* ---- configuration ---- */
+
+static void add_incdir(struct watch_ctx *w, const char *path) {
+    struct stat st;
+    if (w->nincdirs < WATCH_INCDIRS && stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+        snprintf(w->incdirs[w->nincdirs++], PATH_MAX, "%s", path);
+}
+
+/* dependencies/ from `install`: every directory that holds an .inc */
+static void add_dep_incdirs(struct watch_ctx *w, const char *dir, int depth) {
+    char path[PATH_MAX];
+    struct dirent *ent;
+    int has_inc = 0;
+    DIR *d = opendir(dir);
+
+    if (d == NULL)
+        return;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.')
+            continue;
+        size_t len = strlen(ent->d_name);
+        if (len > 4 && strcmp(ent->d_name + len - 4, ".inc") == 0)
+            has_inc = 1;
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        struct stat st;
+        if (depth < 4 && stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+            add_dep_incdirs(w, path, depth + 1);
+    }
+    closedir(d);
+    if (has_inc)
+        add_incdir(w, dir);
+}
+
+static int is_pawnc_dir(const struct dirent *ent) {
+    return strncmp(ent->d_name, "pawnc-", 6) == 0;
+}
+
+static int find_pawncc(struct watch_ctx *w, toml_table_t *watch) {
+    const char *fixed[] = { "pawno/pawncc", "qawno/pawncc", NULL };
+    char path[PATH_MAX];
+    struct dirent **list;
+    int n;
+
+    if (kom_toml_string(watch, "pawncc", w->pawncc, sizeof(w->pawncc)))
+        return access(w->pawncc, X_OK);
+
+    /* downloaded by the `pawncc` command; versionsort puts 3.10.10 after 3.10.9 */
+    if ((n = scandir(".", &list, is_pawnc_dir, versionsort)) > 0) {
+        int found = 0;
+        for (int i = n - 1; i >= 0; i--) {
+            if (!found && snprintf(w->pawncc, sizeof(w->pawncc), "%s/bin/pawncc",
+                                   list[i]->d_name) < (int)sizeof(w->pawncc))
+                found = access(w->pawncc, X_OK) == 0;
+            free(list[i]);
+        }
+        free(list);
+        if (found)
+            return 0;
+    }
+    for (int i = 0; fixed[i]; i++) {
+        snprintf(path, sizeof(path), "%s/%s", w->srv.dir, fixed[i]);
+        if (access(path, X_OK) == 0 || access(fixed[i], X_OK) == 0) {
+            snprintf(w->pawncc, sizeof(w->pawncc), "%s", access(path, X_OK) == 0 ? path : fixed[i]);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int watch_setup(struct watch_ctx *w) {
+    char path[PATH_MAX];
+    toml_table_t *conf = kom_toml_load();
+    toml_table_t *watch = conf ? toml_table_in(conf, "watch") : NULL;
+    toml_table_t *serve = conf ? toml_table_in(conf, "serve") : NULL;
+    int ret = 0;
+
+    if (kom_server_locate(&w->srv, serve) != 0) {
+        /* compiling does not need a server, only the usual layout */
+        snprintf(w->srv.dir, sizeof(w->srv.dir), ".");
+    }
+    if (find_pawncc(w, watch) != 0) {
+        printf_color(COL_RED, "watch: pawncc not found, run \"pawncc\" first or set [watch] pawncc");
+        ret = -1;
+    }
+
+    toml_array_t *inc = watch ? toml_array_in(watch, "include") : NULL;
+    for (int i = 0; inc && i < toml_array_nelem(inc); i++) {
+        toml_datum_t v = toml_string_at(inc, i);
+        if (v.ok) {
+            add_incdir(w, v.u.s);
+            free(v.u.s);
+        }
+    }
+    toml_array_t *flags = watch ? toml_array_in(watch, "flags") : NULL;
+    for (int i = 0; flags && i < toml_array_nelem(flags) && w->nflags < 16; i++) {
+        toml_datum_t v = toml_string_at(flags, i);
+        if (v.ok) {
+            snprintf(w->flags[w->nflags++], sizeof(w->flags[0]), "%s", v.u.s);
+            free(v.u.s);
+        }
+    }
+    if (conf)
+        toml_free(conf);
+
+    if (w->nflags == 0) {
+        const char *defaults[] = { "-d3", "-;+", "-(+" };
+        for (int i = 0; i < 3; i++)
+            snprintf(w->flags[w->nflags++], sizeof(w->flags[0]), "%s", defaults[i]);
+    }
+
+    snprintf(path, sizeof(path), "%s/pawno/include", w->srv.dir);
+    add_incdir(w, path);
+    snprintf(path, sizeof(path), "%s/qawno/include", w->srv.dir);
+    add_incdir(w, path);
+    if (w->pawncc[0]) {
+        /* pawnc-x.y.z-linux/bin/pawncc ships its includes in ../include */
+        char tmp[PATH_MAX];
+        snprintf(tmp, sizeof(tmp), "%s", w->pawncc);
+        snprintf(path, sizeof(path), "%s/../include", dirname(tmp));
+        add_incdir(w, path);
+    }
+    add_dep_incdirs(w, "dependencies", 0);
+    return ret;
+}
+
+/* ---- compile and reload ---- */
+
+/* Run pawncc on t, streaming its diagnostics; 0 when the .amx was built */
+static int watch_compile(struct watch_ctx *w, struct watch_target *t, int *errors, int *warnings) {
+    char out[PATH_MAX], libpath[PATH_MAX * 2 + 2], tmp[PATH_MAX];
+    char incs[WATCH_INCDIRS][PATH_MAX + 2];
+    char *argv[4 + WATCH_INCDIRS + 16];
+    int argc = 0, pp[2];
+
+    snprintf(out, sizeof(out), "-o%.*s.amx", (int)(strlen(t->path) - 4), t->path);
+    argv[argc++] = w->pawncc;
+    argv[argc++] = t->path;
+    argv[argc++] = out;
+    for (int i = 0; i < w->nincdirs; i++) {
+        snprintf(incs[i], sizeof(incs[i]), "-i%s", w->incdirs[i]);
+        argv[argc++] = incs[i];
+    }
+    for (int i = 0; i < w->nflags; i++)
+        argv[argc++] = w->flags[i];
+    argv[argc] = NULL;
+
+    /* pawncc needs libpawnc.so from its own directory or ../lib */
+    snprintf(tmp, sizeof(tmp), "%s", w->pawncc);
+    char *bindir = dirname(tmp);
+    snprintf(libpath, sizeof(libpath), "%s:%s/../lib", bindir, bindir);
+
+    if (pipe2(pp, O_CLOEXEC) != 0)
+        return -1;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pp[0]);
+        close(pp[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        dup2(pp[1], STDOUT_FILENO);
+        dup2(pp[1], STDERR_FILENO);
+        setenv("LD_LIBRARY_PATH", libpath, 1);
+        execv(w->pawncc, argv);
+        _exit(127);
+    }
+    close(pp[1]);
+
+    FILE *fp = fdopen(pp[0], "r");
+    char line[2048];
+    while (fp && fgets(line, sizeof(line), fp)) {
+        if (strstr(line, " error ") || strstr(line, "fatal error")) {
+            (*errors)++;
+            printf("%s%s%s", COL_RED, line, COL_DEFAULT);
+        } else if (strstr(line, " warning ")) {
+            (*warnings)++;
+            printf("%s%s%s", COL_YELLOW, line, COL_DEFAULT);
+        } else if (line[0] != '\n') {
+            fputs(line, stdout);
+        }
+        fflush(stdout);
+    }
+    if (fp)
+        fclose(fp);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/* A reload only counts once the server has answered it */
+static int watch_reload(const struct kom_rcon_target *rcon, const char *cmd) {
+    if (kom_rcon_send(rcon, cmd, 200) > 0)
+        return 1;
+    printf_color(COL_YELLOW, "watch: no rcon reply to \"%s\" from %s:%d", cmd, rcon->host, rcon->port);
+    return 0;
+}
+
+static void watch_cycle(struct watch_ctx *w, const struct timespec *first_event) {
+    struct timespec t0, t1, t2;
+    struct kom_rcon_target rcon;
+    int compiled = 0, failed = 0, errors = 0, warnings = 0, reloads = 0;
+    int have_rcon = kom_rcon_from_dir(&rcon, w->srv.dir) == 0;
+    int gmx = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < w->ntargets; i++) {
+        struct watch_target *t = &w->targets[i];
+        if (!t->dirty)
+            continue;
+        t->dirty = 0;
+
+        println("watch: compiling %s", t->path);
+        if (watch_compile(w, t, &errors, &warnings) != 0) {
+            failed++;
+            continue;
+        }
+        target_rescan(w, t);
+
+        /* size limits from [amx] fail the build like a compile error */
+        char amx[PATH_MAX];
+        snprintf(amx, sizeof(amx), "%.*s.amx", (int)(strlen(t->path) - 4), t->path);
+        if (kom_amx_check(amx, 1) > 0) {
+            failed++;
+            continue;
+        }
+        compiled++;
+
+        if (t->filterscript) {
+            char cmd[160];
+            snprintf(cmd, sizeof(cmd), "reloadfs %s", t->name);
+            if (have_rcon && watch_reload(&rcon, cmd))
+                reloads++;
+        } else {
+            gmx = 1;
+        }
+    }
+    watch_closures(w);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    /* gamemodes restart once per cycle, however many were rebuilt */
+    if (gmx && have_rcon && watch_reload(&rcon, "gmx"))
+        reloads++;
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    if (!have_rcon && compiled)
+        println("watch: no rcon_password in %s, not reloading", w->srv.dir);
+
+    printf_color(failed ? COL_RED : COL_GREEN,
+                 "watch: %d built, %d failed (%d errors, %d warnings) | compile %.0f ms, reload %.0f ms, total %.0f ms",
+                 compiled, failed, errors, warnings,
+                 watch_ms(&t0, &t1), watch_ms(&t1, &t2), watch_ms(first_event, &t2));
+}
+
+/* Mark targets whose closure contains path, adding new .pwn targets */
+static int watch_mark(struct watch_ctx *w, const char *dir, const char *name) {
+    char path[PATH_MAX], real[PATH_MAX];
+    int hits = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (!realpath(path, real))
+        snprintf(real, sizeof(real), "%s", path);
+
+    for (int i = 0; i < w->ntargets; i++) {
+        if (deps_has(&w->targets[i], real)) {
+            w->targets[i].dirty = 1;
+            hits++;
+        }
+    }
+
+    size_t len = strlen(name);
+    if (!hits && len > 4 && strcmp(name + len - 4, ".pwn") == 0) {
+        char gm[PATH_MAX], fs[PATH_MAX], sub[PATH_MAX];
+        snprintf(sub, sizeof(sub), "%s/gamemodes", w->srv.dir);
+        int is_gm = realpath(sub, gm) && strcmp(gm, dir) == 0;
+        snprintf(sub, sizeof(sub), "%s/filterscripts", w->srv.dir);
+        int is_fs = realpath(sub, fs) && strcmp(fs, dir) == 0;
+        if ((is_gm || is_fs) && add_target(w, path, is_fs) == 0) {
+            w->targets[w->ntargets - 1].dirty = 1;
+            hits++;
+        }
+    }
+    return hits;
+}
+
+int call_watch(void) {
+    static struct watch_ctx w;
+    sigset_t mask, oldmask;
+    struct timespec first = { 0 }, last = { 0 };
+    int pending = 0;
+
+    for (int i = 0; i < w.ntargets; i++) {
+        for (int d = 0; d < w.targets[i].ndeps; d++)
+            free(w.targets[i].deps[d]);
+        free(w.targets[i].deps);
+    }
+    memset(&w, 0, sizeof(w));
+    w.ino = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (w.ino < 0) {
+        perror("[err]: inotify");
+        return 1;
+    }
+    if (watch_setup(&w) != 0) {
+        close(w.ino);
+        return 1;
+    }
+
+    find_targets(&w, "gamemodes", 0);
+    find_targets(&w, "filterscripts", 1);
+    for (int i = 0; i < w.nincdirs; i++)
+        watch_dir(&w, w.incdirs[i]);
+    watch_closures(&w);
+
+    if (w.ntargets == 0) {
+        println("watch: no .pwn in %s/gamemodes or %s/filterscripts", w.srv.dir, w.srv.dir);
+        close(w.ino);
+        return 1;
+    }
+    println("watch: %d targets, %d directories, pawncc %s (Ctrl-C to stop)",
+            w.ntargets, w.ndirs, w.pawncc);
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN };
+    ev.data.fd = w.ino;
+    epoll_ctl(ep, EPOLL_CTL_ADD, w.ino, &ev);
+    ev.data.fd = sfd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &ev);
+
+    for (;;) {
+        struct epoll_event events[4];
+        int timeout = -1;
+
+        if (pending) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            timeout = WATCH_DEBOUNCE_MS - (int)watch_ms(&last, &now);
+            if (timeout < 0)
+                timeout = 0;
+        }
+
+        int n = epoll_wait(ep, events, 4, timeout);
+        if (n < 0 && errno != EINTR)
+            break;
+        if (n == 0 && pending) {
+            watch_cycle(&w, &first);
+            pending = 0;
+            continue;
+        }
+
+        int stop = 0;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == sfd) {
+                stop = 1;
+                continue;
+            }
+
+            char buf[8192] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t len;
+            while ((len = read(w.ino, buf, sizeof(buf))) > 0) {
+                for (char *p = buf; p < buf + len;) {
+                    struct inotify_event *ie = (struct inotify_event *)p;
+                    p += sizeof(*ie) + ie->len;
+                    if (ie->len == 0 || !is_source(ie->name))
+                        continue;
+                    for (int d = 0; d < w.ndirs; d++) {
+                        if (w.dirs[d].wd != ie->wd)
+                            continue;
+                        /* build once the burst has been quiet for the debounce period */
+                        if (watch_mark(&w, w.dirs[d].path, ie->name)) {
+                            clock_gettime(CLOCK_MONOTONIC, &last);
+                            if (!pending)
+                                first = last;
+                            pending = 1;
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+        if (stop)
+            break;
+    }
+
+    println("watch: stopped");
+    close(ep);
+    close(sfd);
+    close(w.ino);
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    return 0;
+}
@@ -0,0 +1,16 @@
+/*
+ * Project Name: Komodo Toolchain
+ * Project File: Komodo/watch.h
+ * Copyright (C) Komodo/Contributors
+ *
+ * This program is distributed under the terms of the GNU General Public License v2.0.
+ * See the LICENSE file for details.
+ *
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+int call_watch(void);
+
+#endif